@@ -0,0 +1,403 @@
+#ifndef puzzler_core_mt19937_hpp
+#define puzzler_core_mt19937_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace puzzler
+{
+  /* Polynomials over GF(2), one bit per coefficient, as needed to jump the
+     Mersenne twister ahead. */
+  class Gf2Poly
+  {
+  public:
+    std::vector<uint64_t> words;
+
+    Gf2Poly()
+    {}
+
+    explicit Gf2Poly(size_t bits)
+      : words((bits+63)/64, 0)
+    {}
+
+    bool Bit(size_t i) const
+    { return i/64<words.size() && ((words[i/64]>>(i%64))&1); }
+
+    void Flip(size_t i)
+    {
+      if(i/64>=words.size())
+        words.resize(i/64+1, 0);
+      words[i/64]^=uint64_t(1)<<(i%64);
+    }
+
+    // Index of the highest set coefficient, or -1 for the zero polynomial
+    long Degree() const
+    {
+      for(size_t w=words.size(); w-->0; ){
+        if(words[w]){
+          long bit=63;
+          while(!((words[w]>>bit)&1))
+            bit--;
+          return long(w*64)+bit;
+        }
+      }
+      return -1;
+    }
+
+    // this ^= other * x^shift
+    void XorShifted(const Gf2Poly &other, size_t shift)
+    {
+      size_t ws=shift/64, bs=shift%64;
+      if(words.size()<other.words.size()+ws+1)
+        words.resize(other.words.size()+ws+1, 0);
+      if(bs==0){
+        for(size_t i=0; i<other.words.size(); i++)
+          words[i+ws]^=other.words[i];
+      }else{
+        for(size_t i=0; i<other.words.size(); i++){
+          words[i+ws]^=other.words[i]<<bs;
+          words[i+ws+1]^=other.words[i]>>(64-bs);
+        }
+      }
+    }
+  };
+
+  /* std::mt19937, output for output, but with a whole block of state
+     twisted at a time in loops the compiler can vectorise, and with
+     polynomial jump-ahead so distant parts of the sequence can be generated
+     independently and in parallel.
+
+     Jumping by J outputs evaluates g(T) on the state, where T is the one
+     word step of the recurrence and g(x) = x^J mod phi(x), phi being the
+     characteristic polynomial of the generator. phi is found once per
+     process by Berlekamp-Massey on 2 * 19937 output bits, and x^J mod phi
+     by repeated squaring. Finding phi or a jump polynomial takes about 40ms
+     and applying one about 4ms, so jumping only pays for itself over tens
+     of millions of outputs. */
+  class Mt19937
+  {
+  public:
+    static const unsigned stateSize=624;
+    static const unsigned shiftSize=397;
+    static const unsigned degree=19937;
+
+    // Discards shorter than this step through the sequence instead of jumping
+    static const uint64_t jumpThreshold=uint64_t(1)<<25;
+
+    explicit Mt19937(uint32_t seed=5489u)
+    { Seed(seed); }
+
+    void Seed(uint32_t seed)
+    {
+      m_state[0]=seed;
+      for(unsigned i=1; i<stateSize; i++)
+        m_state[i]=1812433253u*(m_state[i-1]^(m_state[i-1]>>30))+i;
+      m_index=stateSize;
+    }
+
+    uint32_t operator()()
+    {
+      if(m_index==stateSize)
+        Twist();
+      return Temper(m_state[m_index++]);
+    }
+
+    // The next count outputs
+    void Generate(uint32_t *out, size_t count)
+    {
+      while(count>0){
+        if(m_index==stateSize)
+          Twist();
+        size_t k=std::min<size_t>(count, stateSize-m_index);
+        const uint32_t *src=m_state+m_index;
+        for(size_t i=0; i<k; i++)
+          out[i]=Temper(src[i]);
+        out+=k;
+        count-=k;
+        m_index+=k;
+      }
+    }
+
+    // Skip count outputs, as std::mt19937::discard
+    void Discard(uint64_t count)
+    {
+      if(count<jumpThreshold){
+        while(count>0){
+          if(m_index==stateSize)
+            Twist();
+          uint64_t k=std::min<uint64_t>(count, stateSize-m_index);
+          m_index+=k;
+          count-=k;
+        }
+        return;
+      }
+      Jump(JumpPolynomial(Aligned(count)), count);
+    }
+
+    /* Jump by count outputs given JumpPolynomial(Aligned(count)), so one
+       polynomial can be reused for many jumps of the same length. */
+    void Jump(const Gf2Poly &poly, uint64_t count)
+    {
+      /* The state array holds the n words before the next one the recurrence
+         produces. Jump it to the block just before the one holding the
+         target output, whose first word the polynomial only gets right in
+         its top bit, then twist that block out as usual. */
+      uint64_t ahead=m_index+count;
+      ApplyPolynomial(poly);
+      m_index=stateSize;
+      if(ahead%stateSize){
+        Twist();
+        m_index=ahead%stateSize;
+      }
+    }
+
+    // Length of the state jump that Jump(., count) applies from this position
+    uint64_t Aligned(uint64_t count) const
+    { return (m_index+count)/stateSize*stateSize-stateSize; }
+
+    // x^steps mod phi(x), for Jump
+    static Gf2Poly JumpPolynomial(uint64_t steps)
+    {
+      const Reducer &r=GetReducer();
+      Gf2Poly g(1);
+      g.Flip(0);
+      for(int bit=63; bit>=0; bit--){
+        // Square: in GF(2) this just spreads the bits out
+        Gf2Poly sq(2*(g.words.size()*64));
+        for(size_t w=0; w<g.words.size(); w++){
+          sq.words[2*w]=Spread(uint32_t(g.words[w]));
+          sq.words[2*w+1]=Spread(uint32_t(g.words[w]>>32));
+        }
+        g=sq;
+        r.Reduce(g);
+        if((steps>>bit)&1){
+          Gf2Poly x;
+          x.XorShifted(g, 1);
+          g=x;
+          r.Reduce(g);
+        }
+      }
+      return g;
+    }
+
+  private:
+    uint32_t m_state[stateSize];
+    unsigned m_index;
+
+    static uint32_t Temper(uint32_t y)
+    {
+      y^=y>>11;
+      y^=(y<<7)&0x9d2c5680u;
+      y^=(y<<15)&0xefc60000u;
+      y^=y>>18;
+      return y;
+    }
+
+    static uint32_t Next(uint32_t x0, uint32_t x1, uint32_t xm)
+    {
+      uint32_t y=(x0&0x80000000u)|(x1&0x7fffffffu);
+      return xm^(y>>1)^((0u-(y&1))&0x9908b0dfu);
+    }
+
+    // Replace the block with the next stateSize words of the recurrence
+    void Twist()
+    {
+      uint32_t *s=m_state;
+      for(unsigned j=0; j<stateSize-shiftSize; j++)
+        s[j]=Next(s[j], s[j+1], s[j+shiftSize]);
+      for(unsigned j=stateSize-shiftSize; j<stateSize-1; j++)
+        s[j]=Next(s[j], s[j+1], s[j+shiftSize-stateSize]);
+      s[stateSize-1]=Next(s[stateSize-1], s[0], s[shiftSize-1]);
+      m_index=0;
+    }
+
+    static bool Parity(uint64_t x)
+    {
+#if defined(__GNUC__)
+      return __builtin_parityll(x);
+#else
+      x^=x>>32;
+      x^=x>>16;
+      x^=x>>8;
+      x^=x>>4;
+      x^=x>>2;
+      x^=x>>1;
+      return x&1;
+#endif
+    }
+
+    static uint64_t Spread(uint32_t x)
+    {
+      uint64_t v=x;
+      v=(v|(v<<16))&0x0000ffff0000ffffull;
+      v=(v|(v<<8))&0x00ff00ff00ff00ffull;
+      v=(v|(v<<4))&0x0f0f0f0f0f0f0f0full;
+      v=(v|(v<<2))&0x3333333333333333ull;
+      v=(v|(v<<1))&0x5555555555555555ull;
+      return v;
+    }
+
+    // state = g(T) state, summing T^i state over the set coefficients of g
+    void ApplyPolynomial(const Gf2Poly &g)
+    {
+      uint32_t acc[stateSize], cur[stateSize];
+      memset(acc, 0, sizeof(acc));
+      memcpy(cur, m_state, sizeof(cur));
+      // cur is a circular window starting at p
+      unsigned p=0;
+      long top=g.Degree();
+      for(long i=0; i<=top; i++){
+        if(g.Bit(i)){
+          for(unsigned j=0; j<stateSize-p; j++)
+            acc[j]^=cur[p+j];
+          for(unsigned j=stateSize-p; j<stateSize; j++)
+            acc[j]^=cur[j+p-stateSize];
+        }
+        unsigned p1=p+1==stateSize ? 0 : p+1;
+        unsigned pm=p+shiftSize>=stateSize ? p+shiftSize-stateSize : p+shiftSize;
+        cur[p]=Next(cur[p], cur[p1], cur[pm]);
+        p=p1;
+      }
+      memcpy(m_state, acc, sizeof(acc));
+    }
+
+    // phi(x) and the reduction modulo it
+    class Reducer
+    {
+    public:
+      Reducer()
+      {
+        Gf2Poly phi=CharacteristicPolynomial();
+        // phi shifted by 0..63 bits, so each reduction step is a word aligned xor
+        m_shifted.resize(64);
+        for(unsigned k=0; k<64; k++)
+          m_shifted[k].XorShifted(phi, k);
+      }
+
+      void Reduce(Gf2Poly &a) const
+      {
+        for(long i=a.Degree(); i>=long(degree); i--){
+          if(!a.Bit(i))
+            continue;
+          size_t s=i-degree;
+          const std::vector<uint64_t> &src=m_shifted[s%64].words;
+          size_t ws=s/64;
+          for(size_t w=0; w<src.size() && w+ws<a.words.size(); w++)
+            a.words[w+ws]^=src[w];
+        }
+        a.words.resize((degree+63)/64);
+      }
+
+    private:
+      std::vector<Gf2Poly> m_shifted;
+
+      // Berlekamp-Massey on the top bit of successive words of the recurrence
+      static Gf2Poly CharacteristicPolynomial()
+      {
+        const size_t n=2*degree, words=(degree+1+63)/64;
+        Mt19937 gen;
+        // The sequence reversed, bit n-1-k holding element k, so the
+        // discrepancy is a word-wise dot product with the connection polynomial
+        std::vector<uint64_t> r((n+63)/64+words+1, 0);
+        for(size_t k=0; k<n; k++)
+          if(gen.Raw()>>31)
+            r[(n-1-k)/64]|=uint64_t(1)<<((n-1-k)%64);
+
+        Gf2Poly c(64*words), b(64*words);
+        c.Flip(0);
+        b.Flip(0);
+        size_t L=0, m=1;
+        for(size_t k=0; k<n; k++){
+          // d = sum over i of c_i s_{k-i}, c_0 being 1
+          size_t o=n-1-k, ow=o/64, ob=o%64;
+          uint64_t d=0;
+          for(size_t w=0; w<words; w++){
+            uint64_t x=r[ow+w]>>ob;
+            if(ob)
+              x|=r[ow+w+1]<<(64-ob);
+            d^=c.words[w]&x;
+          }
+          if(!Parity(d)){
+            m++;
+          }else if(2*L<=k){
+            Gf2Poly t=c;
+            c.XorShifted(b, m);
+            c.words.resize(words);
+            L=k+1-L;
+            b=t;
+            m=1;
+          }else{
+            c.XorShifted(b, m);
+            c.words.resize(words);
+            m++;
+          }
+        }
+        if(L!=degree)
+          throw std::runtime_error("Mt19937::CharacteristicPolynomial - unexpected linear complexity.");
+
+        // phi(x) = x^L c(1/x)
+        Gf2Poly phi(degree+1);
+        for(size_t i=0; i<=L; i++)
+          if(c.Bit(i))
+            phi.Flip(L-i);
+        return phi;
+      }
+    };
+
+    static const Reducer &GetReducer()
+    {
+      static const Reducer reducer;
+      return reducer;
+    }
+
+    // The next untempered word of the recurrence
+    uint32_t Raw()
+    {
+      if(m_index==stateSize)
+        Twist();
+      return m_state[m_index++];
+    }
+  };
+
+  /* The first count outputs of std::mt19937(seed). Large fills are split
+     into one chunk per hardware thread, each generator jumped ahead from
+     the previous one, and the chunks generated in parallel. */
+  inline void Mt19937Fill(uint32_t seed, uint32_t *out, size_t count, unsigned threads=0)
+  {
+    // Below this a single thread is faster than finding the jump polynomial
+    const size_t parallelThreshold=size_t(1)<<26;
+
+    if(threads==0)
+      threads=std::max(1u, std::thread::hardware_concurrency());
+    if(threads==1 || count<parallelThreshold){
+      Mt19937 gen(seed);
+      gen.Generate(out, count);
+      return;
+    }
+
+    // Whole blocks, so every jump leaves the generator at the same point of a block
+    size_t chunk=(count+threads-1)/threads;
+    chunk=(chunk+Mt19937::stateSize-1)/Mt19937::stateSize*Mt19937::stateSize;
+    std::vector<Mt19937> gens(threads, Mt19937(seed));
+    Gf2Poly poly=Mt19937::JumpPolynomial(gens[0].Aligned(chunk));
+    for(unsigned t=1; t<threads; t++){
+      gens[t]=gens[t-1];
+      gens[t].Jump(poly, chunk);
+    }
+    std::vector<std::thread> workers;
+    for(unsigned t=0; t<threads; t++){
+      size_t first=std::min(count, t*chunk), last=std::min(count, first+chunk);
+      workers.push_back(std::thread([&gens, out, t, first, last](){
+        gens[t].Generate(out+first, last-first);
+      }));
+    }
+    for(auto &w: workers)
+      w.join();
+  }
+}; // puzzler
+
+#endif
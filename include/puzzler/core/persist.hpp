@@ -4,6 +4,11 @@
 #include "puzzler/core/stream.hpp"
 
 #include <complex>
+#include <algorithm>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 namespace puzzler{
 
@@ -18,17 +23,215 @@ namespace puzzler{
     virtual void Persist(PersistContext &ctxt) =0;
   };
 
+  /* Moves values through a stream in one of two encodings.
+
+     The v0 encoding is big-endian, with every value where it falls. The v1
+     (native) encoding is switched to by BeginNative once the header strings
+     are through: it starts with a byte order mark, then values are in the
+     byte order of the writer, and each array of words is preceded by padding
+     which puts its first element on a 64 byte boundary of the stream. A
+     reader with the other byte order swaps as it receives. */
   class PersistContext
   {
+  public:
+    static const uint32_t byteOrderMark=0x01020304;
+    static const uint32_t nativeAlignment=64;
   private:
     bool m_sending;
     Stream *m_pStream;
+    bool m_native;
+    bool m_swap;
+
+    // Words byte-swapped per Send when sending a block
+    static const size_t blockWords=4096;
+
+    static bool IsBigEndian()
+    { return htonl(1)==1; }
+
+    static uint32_t ByteSwap(uint32_t x)
+    { return (x>>24) | ((x>>8)&0xFF00) | ((x<<8)&0xFF0000) | (x<<24); }
+
+    static uint64_t ByteSwap(uint64_t x)
+    { return (uint64_t(ByteSwap(uint32_t(x)))<<32) | ByteSwap(uint32_t(x>>32)); }
+
+    // Copy n words between host and network order; src may equal dst
+    template<class W>
+    static void SwapWords(const W *src, W *dst, size_t n)
+    {
+      if(IsBigEndian()){
+        if(src!=dst)
+          memcpy(dst, src, n*sizeof(W));
+        return;
+      }
+      ByteSwapWords(src, dst, n);
+    }
+
+    // Copy n words reversing the bytes of each; src may equal dst
+    static void ByteSwapWords(const uint32_t *src, uint32_t *dst, size_t n)
+    {
+      size_t i=0;
+#ifdef __SSSE3__
+      const __m128i order=_mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+      for(; i+4<=n; i+=4){
+        __m128i v=_mm_loadu_si128((const __m128i*)(src+i));
+        _mm_storeu_si128((__m128i*)(dst+i), _mm_shuffle_epi8(v, order));
+      }
+#endif
+      for(; i<n; i++)
+        dst[i]=ByteSwap(src[i]);
+    }
+
+    static void ByteSwapWords(const uint64_t *src, uint64_t *dst, size_t n)
+    {
+      size_t i=0;
+#ifdef __SSSE3__
+      const __m128i order=_mm_set_epi8(8,9,10,11,12,13,14,15, 0,1,2,3,4,5,6,7);
+      for(; i+2<=n; i+=2){
+        __m128i v=_mm_loadu_si128((const __m128i*)(src+i));
+        _mm_storeu_si128((__m128i*)(dst+i), _mm_shuffle_epi8(v, order));
+      }
+#endif
+      for(; i<n; i++)
+        dst[i]=ByteSwap(src[i]);
+    }
+
+    /* The padding before an array in the native encoding: a word giving its
+       length, then that many zero bytes. The reader just skips it, so the
+       arrays stay readable whatever offset the stream started at. */
+    void SendOrRecvPadding()
+    {
+      uint32_t pad=0;
+      if(m_sending)
+        pad=(nativeAlignment-(m_pStream->SendOffset()+4)%nativeAlignment)%nativeAlignment;
+      SendOrRecv(pad);
+      if(pad>=nativeAlignment)
+        throw std::runtime_error("PersistContext::SendOrRecvPadding - Padding is corrupt.");
+      uint8_t zeros[nativeAlignment]={0};
+      if(m_sending){
+        m_pStream->Send(pad, zeros);
+      }else{
+        m_pStream->Recv(pad, zeros);
+      }
+    }
+
+    // The n words of a vector whose count and padding have been received, a block at a time
+    template<class W, class F>
+    void RecvWordBlocks(uint32_t n, F sink)
+    {
+      // Blocks of a few hundred KB, so the sink sees them while they are in cache
+      std::vector<W> tmp(std::min(size_t(n), size_t(blockWords)*16));
+      for(size_t i=0; i<n; i+=tmp.size()){
+        size_t k=std::min(tmp.size(), n-i);
+        const void *view;
+        if(!m_native){
+          if(m_pStream->RecvView(k*sizeof(W), view)){
+            SwapWords((const W*)view, &tmp[0], k);
+          }else{
+            m_pStream->Recv(k*sizeof(W), &tmp[0]);
+            SwapWords(&tmp[0], &tmp[0], k);
+          }
+          sink((const W*)&tmp[0], k);
+        }else if(m_pStream->RecvView(k*sizeof(W), view)){
+          if(m_swap){
+            ByteSwapWords((const W*)view, &tmp[0], k);
+            sink((const W*)&tmp[0], k);
+          }else{
+            sink((const W*)view, k);
+          }
+        }else{
+          m_pStream->Recv(k*sizeof(W), &tmp[0]);
+          if(m_swap)
+            ByteSwapWords(&tmp[0], &tmp[0], k);
+          sink((const W*)&tmp[0], k);
+        }
+      }
+    }
+
+    /* A vector of T as a block of n*sizeof(T)/sizeof(W) big-endian words,
+       exactly as sending each element in turn would, but with one Send or
+       Recv per block rather than per word. */
+    template<class W, class T>
+    PersistContext &SendOrRecvWords(std::vector<T> &x)
+    {
+      static_assert(sizeof(T)%sizeof(W)==0, "PersistContext::SendOrRecvWords - element is not made of words.");
+
+      uint32_t n=x.size();
+      SendOrRecv(n);
+      x.resize(n);
+      size_t count=size_t(n)*(sizeof(T)/sizeof(W));
+      if(count==0)
+        return *this;
+
+      W *p=reinterpret_cast<W*>(&x[0]);
+      if(m_native){
+        SendOrRecvPadding();
+        if(m_sending){
+          m_pStream->Send(count*sizeof(W), p);
+          return *this;
+        }
+        const void *view;
+        if(m_pStream->RecvView(count*sizeof(W), view)){
+          if(m_swap){
+            ByteSwapWords((const W*)view, p, count);
+          }else{
+            memcpy(p, view, count*sizeof(W));
+          }
+        }else{
+          m_pStream->Recv(count*sizeof(W), p);
+          if(m_swap)
+            ByteSwapWords(p, p, count);
+        }
+      }else if(m_sending){
+        std::vector<W> tmp(std::min(count, size_t(blockWords)));
+        for(size_t i=0; i<count; i+=tmp.size()){
+          size_t k=std::min(tmp.size(), count-i);
+          SwapWords(p+i, &tmp[0], k);
+          m_pStream->Send(k*sizeof(W), &tmp[0]);
+        }
+      }else{
+        // Swap straight out of a mapped input when there is one
+        const void *view;
+        if(m_pStream->RecvView(count*sizeof(W), view)){
+          SwapWords((const W*)view, p, count);
+        }else{
+          m_pStream->Recv(count*sizeof(W), p);
+          SwapWords(p, p, count);
+        }
+      }
+      return *this;
+    }
   public:
     PersistContext(Stream *pStream, bool isSending)
       : m_sending(isSending)
       , m_pStream(pStream)
+      , m_native(false)
+      , m_swap(false)
     {}
 
+    bool IsSending() const
+    { return m_sending; }
+
+    //! True once BeginNative has been called
+    bool IsNative() const
+    { return m_native; }
+
+    //! Send or receive the byte order mark, and use the native encoding from here on
+    void BeginNative()
+    {
+      uint32_t mark=byteOrderMark;
+      if(m_sending){
+        m_pStream->Send(4, &mark);
+      }else{
+        m_pStream->Recv(4, &mark);
+        if(mark==ByteSwap(uint32_t(byteOrderMark))){
+          m_swap=true;
+        }else if(mark!=byteOrderMark){
+          throw std::runtime_error("PersistContext::BeginNative - Invalid byte order mark.");
+        }
+      }
+      m_native=true;
+    }
+
     template<class T>
     PersistContext &SendOrRecv(T &x)
     {
@@ -38,6 +241,16 @@ namespace puzzler{
 
     PersistContext &SendOrRecv(uint32_t &x)
     {
+      if(m_native){
+        if(m_sending){
+          m_pStream->Send(4, &x);
+        }else{
+          m_pStream->Recv(4, &x);
+          if(m_swap)
+            x=ByteSwap(x);
+        }
+        return *this;
+      }
       uint32_t raw=htonl(x);
       if(m_sending){
         m_pStream->Send(4, &raw);
@@ -50,6 +263,16 @@ namespace puzzler{
 
     PersistContext &SendOrRecv(uint64_t &x)
     {
+      if(m_native){
+        if(m_sending){
+          m_pStream->Send(8, &x);
+        }else{
+          m_pStream->Recv(8, &x);
+          if(m_swap)
+            x=ByteSwap(x);
+        }
+        return *this;
+      }
       uint32_t hi=(x>>32), lo=uint32_t(x&0xFFFFFFFFUL);
       SendOrRecv(hi);
       SendOrRecv(lo);
@@ -160,6 +383,10 @@ namespace puzzler{
       uint32_t n=x.size();
       SendOrRecv(n);
       x.resize(n);
+      if(n==0)
+        return *this;
+      if(m_native)
+        SendOrRecvPadding();
       if(m_sending){
         m_pStream->Send(x.size(), &x[0]);
       }else{
@@ -168,6 +395,27 @@ namespace puzzler{
       return *this;
     }
 
+    PersistContext &SendOrRecv(std::vector<uint32_t> &x)
+    { return SendOrRecvWords<uint32_t>(x); }
+
+    PersistContext &SendOrRecv(std::vector<int32_t> &x)
+    { return SendOrRecvWords<uint32_t>(x); }
+
+    PersistContext &SendOrRecv(std::vector<float> &x)
+    { return SendOrRecvWords<uint32_t>(x); }
+
+    PersistContext &SendOrRecv(std::vector<uint64_t> &x)
+    { return SendOrRecvWords<uint64_t>(x); }
+
+    PersistContext &SendOrRecv(std::vector<double> &x)
+    { return SendOrRecvWords<uint64_t>(x); }
+
+    PersistContext &SendOrRecv(std::vector<std::pair<uint32_t,uint32_t> > &x)
+    {
+      static_assert(sizeof(std::pair<uint32_t,uint32_t>)==8, "PersistContext::SendOrRecv - pair is padded.");
+      return SendOrRecvWords<uint32_t>(x);
+    }
+
     template<class T>
     PersistContext &SendOrRecv(std::vector<T> &x)
     {
@@ -180,6 +428,85 @@ namespace puzzler{
       return *this;
     }
     
+    /* Send n words from p exactly as SendOrRecv of a vector holding them
+       would, for arrays that are not held in a vector. */
+    template<class W>
+    PersistContext &SendWords(const W *p, uint32_t n)
+    {
+      if(!m_sending)
+        throw std::runtime_error("PersistContext::SendWords - Not sending.");
+      SendOrRecv(n);
+      if(n==0)
+        return *this;
+      if(m_native){
+        SendOrRecvPadding();
+        m_pStream->Send(size_t(n)*sizeof(W), p);
+        return *this;
+      }
+      std::vector<W> tmp(std::min(size_t(n), size_t(blockWords)));
+      for(size_t i=0; i<n; i+=tmp.size()){
+        size_t k=std::min(tmp.size(), n-i);
+        SwapWords(p+i, &tmp[0], k);
+        m_pStream->Send(k*sizeof(W), &tmp[0]);
+      }
+      return *this;
+    }
+
+    /* Receive a vector of words as SendOrRecv would, but pass them to
+       sink(p, k) a block at a time rather than holding them all, for arrays
+       that may not fit in memory. Returns the number of words. */
+    template<class W, class F>
+    uint32_t RecvWords(F sink)
+    {
+      if(m_sending)
+        throw std::runtime_error("PersistContext::RecvWords - Not receiving.");
+      uint32_t n=0;
+      SendOrRecv(n);
+      if(n==0)
+        return n;
+      if(m_native)
+        SendOrRecvPadding();
+      RecvWordBlocks<W>(n, sink);
+      return n;
+    }
+
+    /* Receive a vector of words as RecvWords does, but where the stream
+       holds them in a mapped file in native byte order point p at them
+       there, with owner keeping the mapping alive, rather than copying.
+       Otherwise p is null and the words go to sink as with RecvWords. */
+    template<class W, class F>
+    uint32_t RecvWordsMapped(const W *&p, std::shared_ptr<const void> &owner, F sink)
+    {
+      if(m_sending)
+        throw std::runtime_error("PersistContext::RecvWordsMapped - Not receiving.");
+      p=NULL;
+      uint32_t n=0;
+      SendOrRecv(n);
+      if(n==0)
+        return n;
+      if(m_native)
+        SendOrRecvPadding();
+      const void *view;
+      if(m_native && !m_swap && m_pStream->RecvMapped(size_t(n)*sizeof(W), view, owner)){
+        if(uintptr_t(view)%alignof(W)==0){
+          p=(const W*)view;
+          return n;
+        }
+        // Not aligned for W, so copy out in blocks after all
+        std::vector<W> tmp(std::min(size_t(n), size_t(blockWords)*16));
+        for(size_t i=0; i<n; i+=tmp.size()){
+          size_t k=std::min(tmp.size(), n-i);
+          memcpy(&tmp[0], (const uint8_t*)view+i*sizeof(W), k*sizeof(W));
+          sink((const W*)&tmp[0], k);
+        }
+        owner.reset();
+        return n;
+      }
+      RecvWordBlocks<W>(n, sink);
+      return n;
+    }
+
+
     template<class T>
     PersistContext &SendOrRecv(std::complex<T> &x)
     {
@@ -9,6 +9,25 @@
 namespace puzzler
 {
 
+  /* Format strings are "puzzle.input.vN" and "puzzle.output.vN". Version 0
+     is big-endian throughout; version 1 switches the context to its native
+     encoding straight after the puzzle name (see PersistContext). */
+  inline std::string PuzzleFormatString(std::string kind, unsigned version)
+  {
+    if(version>1)
+      throw std::runtime_error("PuzzleFormatString - Unknown format version.");
+    return "puzzle."+kind+".v"+(version ? "1" : "0");
+  }
+
+  inline unsigned PuzzleFormatVersion(std::string kind, std::string format)
+  {
+    for(unsigned version=0; version<=1; version++){
+      if(format==PuzzleFormatString(kind, version))
+        return version;
+    }
+    throw std::runtime_error("PuzzleFormatVersion - Invalid format string '"+format+"'.");
+  }
+
   class Puzzle
   {
   public:
@@ -31,8 +50,8 @@ namespace puzzler
 	: m_format(format)
 	, m_puzzleName(puzzleName)
       {
-	if(format!="puzzle.input.v0")
-	  throw std::runtime_error("Puzzle::Input - Invalid format string.");
+	if(PuzzleFormatVersion("input", format)==1)
+	  ctxt.BeginNative();
 	ctxt.SendOrRecv(m_scale);
       }
 
@@ -40,8 +59,11 @@ namespace puzzler
     public:
       virtual void Persist(PersistContext &ctxt) override final
       {
-	ctxt.SendOrRecv(m_format,"puzzle.input.v0");
+	ctxt.SendOrRecv(m_format);
+	unsigned version=PuzzleFormatVersion("input", m_format);
 	ctxt.SendOrRecv(m_puzzleName);
+	if(version==1)
+	  ctxt.BeginNative();
 	ctxt.SendOrRecv(m_scale);
 	PersistImpl(ctxt);
       }
@@ -50,6 +72,13 @@ namespace puzzler
     public:
       std::string PuzzleName() const
       { return m_puzzleName; }
+
+      unsigned FormatVersion() const
+      { return PuzzleFormatVersion("input", m_format); }
+
+      //! Choose the format used when this is next sent
+      void SetFormatVersion(unsigned version)
+      { m_format=PuzzleFormatString("input", version); }
     };
 
     class Output
@@ -59,26 +88,30 @@ namespace puzzler
       std::string m_format;
       std::string m_puzzleName;
     protected:
-      Output(const Puzzle *puzzle, const Input *)
-	: m_format("puzzle.output.v0")
+      // Outputs are written in the format their input arrived in
+      Output(const Puzzle *puzzle, const Input *input)
+	: m_format(PuzzleFormatString("output", input ? input->FormatVersion() : 0))
 	, m_puzzleName(puzzle->Name())
       {
       }
 
-      Output(std::string format, std::string puzzleName, PersistContext &)
+      Output(std::string format, std::string puzzleName, PersistContext &ctxt)
 	: m_format(format)
 	, m_puzzleName(puzzleName)
       {
-	if(format!="puzzle.output.v0")
-	  throw std::runtime_error("Puzzle::Output - Invalid format string.");
+	if(PuzzleFormatVersion("output", format)==1)
+	  ctxt.BeginNative();
       }
 
       virtual void PersistImpl(PersistContext &ctxt) =0;
     public:
       virtual void Persist(PersistContext &ctxt) override final
       {
-	ctxt.SendOrRecv(m_format, "puzzle.output.v0");
+	ctxt.SendOrRecv(m_format);
+	unsigned version=PuzzleFormatVersion("output", m_format);
 	ctxt.SendOrRecv(m_puzzleName);
+	if(version==1)
+	  ctxt.BeginNative();
 	PersistImpl(ctxt);
       }
 
@@ -86,6 +119,13 @@ namespace puzzler
 
       std::string PuzzleName() const
       { return m_puzzleName; }
+
+      unsigned FormatVersion() const
+      { return PuzzleFormatVersion("output", m_format); }
+
+      //! Choose the format used when this is next sent
+      void SetFormatVersion(unsigned version)
+      { m_format=PuzzleFormatString("output", version); }
     };
 
   public:
@@ -100,6 +140,12 @@ namespace puzzler
 
     virtual std::shared_ptr<Input> LoadInput(std::string format, std::string name, PersistContext &ctxt) const=0;
 
+    /*! Load an input that only Execute will be run on, so the user may hold
+        it however suits Execute. The reference and the tools that convert or
+        hash inputs use LoadInput. */
+    virtual std::shared_ptr<Input> LoadInputToExecute(std::string format, std::string name, PersistContext &ctxt) const
+    { return LoadInput(format, name, ctxt); }
+
     //! Create a class that can hold instances of output
     virtual std::shared_ptr<Output> MakeEmptyOutput(const Input *input) const=0;
 
@@ -133,7 +179,8 @@ namespace puzzler
       Registry()[puzzle->Name()]=puzzle;
     }
 
-    static std::shared_ptr<Puzzle::Input> LoadInput(PersistContext &ctxt)
+    //! Load any registered input, for Execute alone if toExecute is set
+    static std::shared_ptr<Puzzle::Input> LoadInput(PersistContext &ctxt, bool toExecute=false)
     {
       std::string format, name;
       ctxt.SendOrRecv(format).SendOrRecv(name);
@@ -143,6 +190,8 @@ namespace puzzler
 	throw std::runtime_error("PuzzleRegistrar::LoadInput - No handler for type '"+name+"'");
       }
 
+      if(toExecute)
+	return puzzle->LoadInputToExecute(format, name, ctxt);
       return puzzle->LoadInput(format, name, ctxt);
     }
 
@@ -0,0 +1,268 @@
+#ifndef puzzler_core_result_cache_hpp
+#define puzzler_core_result_cache_hpp
+
+#include "puzzler/core/puzzle.hpp"
+#include "puzzler/core/sha256.hpp"
+#include "puzzler/core/streams/file_in_stream.hpp"
+
+#include <algorithm>
+
+#if defined(__CYGWIN__) || !(defined(_WIN32) || defined(_WIN64))
+#include <dirent.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define PUZZLER_HAVE_RESULT_CACHE
+#endif
+
+// Hash of the reference puzzles and the formats they persist in, set by the
+// makefile. Without it every build gets its own reference entries.
+#ifndef PUZZLER_REFERENCE_HASH
+#define PUZZLER_REFERENCE_HASH __DATE__ " " __TIME__
+#endif
+
+namespace puzzler{
+
+  /* Outputs on local disk, keyed by the SHA-256 of an implementation id and
+     the input, so slow reference runs and repeated regression runs of the
+     same input only execute once.
+
+     The key hashes the input as it would be persisted in format version 0,
+     so the same input in version 1 or compressed finds the same entry.
+     Entries are v0 outputs named by their key. A hit refreshes the entry's
+     modification time, and storing an entry removes the least recently used
+     ones until the directory is within its size limit.
+
+     HPCE_RESULT_CACHE_DIR names the directory and turns the cache on;
+     HPCE_RESULT_CACHE_MB bounds its size (default 1024). Only reference
+     outputs are reused unless HPCE_RESULT_CACHE_EXECUTE=1, as Execute is
+     usually being run to time it. */
+  class ResultCache
+  {
+  private:
+    // No implementation for either
+    ResultCache(const ResultCache &); // = delete;
+    ResultCache &operator=(const ResultCache &); // = delete;
+
+    ILog *m_log;
+    std::string m_dir;
+    uint64_t m_maxBytes;
+    bool m_cacheExecute;
+
+    // Feeds everything sent into a hash
+    class HashStream
+      : public Stream
+    {
+    private:
+      uint64_t m_offset;
+    public:
+      Sha256 hash;
+
+      HashStream()
+        : m_offset(0)
+      {}
+
+      virtual void Send(size_t cbData, const void *pData)
+      {
+        hash.Update(pData, cbData);
+        m_offset+=cbData;
+      }
+
+      virtual void Recv(size_t , void *)
+      { throw std::runtime_error("ResultCache::HashStream::Recv - no such operation."); }
+
+      virtual uint64_t SendOffset() const
+      { return m_offset; }
+
+      virtual uint64_t RecvOffset() const
+      { return 0; }
+    };
+
+    // Collects everything sent
+    class VectorStream
+      : public Stream
+    {
+    public:
+      std::vector<uint8_t> data;
+
+      virtual void Send(size_t cbData, const void *pData)
+      { data.insert(data.end(), (const uint8_t*)pData, (const uint8_t*)pData+cbData); }
+
+      virtual void Recv(size_t , void *)
+      { throw std::runtime_error("ResultCache::VectorStream::Recv - no such operation."); }
+
+      virtual uint64_t SendOffset() const
+      { return data.size(); }
+
+      virtual uint64_t RecvOffset() const
+      { return 0; }
+    };
+
+    std::string Path(const std::string &key) const
+    { return m_dir+"/"+key+".out"; }
+
+    // Remove the oldest entries until the rest fit in m_maxBytes
+    void Evict() const
+    {
+#ifdef PUZZLER_HAVE_RESULT_CACHE
+      DIR *dir=opendir(m_dir.c_str());
+      if(!dir)
+        return;
+      std::vector<std::pair<time_t,std::pair<uint64_t,std::string> > > entries;
+      uint64_t total=0;
+      while(struct dirent *ent=readdir(dir)){
+        std::string name=ent->d_name;
+        if(name.size()!=68 || name.compare(64, 4, ".out")!=0)
+          continue;
+        struct stat st;
+        if(stat((m_dir+"/"+name).c_str(), &st)!=0)
+          continue;
+        entries.push_back(std::make_pair(st.st_mtime, std::make_pair(uint64_t(st.st_size), name)));
+        total+=st.st_size;
+      }
+      closedir(dir);
+
+      std::sort(entries.begin(), entries.end());
+      for(unsigned i=0; i<entries.size() && total>m_maxBytes; i++){
+        if(unlink((m_dir+"/"+entries[i].second.second).c_str())==0){
+          m_log->LogVerbose("ResultCache - Evicted %s", entries[i].second.second.c_str());
+          total-=entries[i].second.first;
+        }
+      }
+#endif
+    }
+  public:
+    ResultCache(ILog *log)
+      : m_log(log)
+      , m_maxBytes(uint64_t(1024)<<20)
+      , m_cacheExecute(false)
+    {
+#ifdef PUZZLER_HAVE_RESULT_CACHE
+      const char *str;
+      if((str=getenv("HPCE_RESULT_CACHE_DIR"))!=NULL)
+        m_dir=str;
+      if((str=getenv("HPCE_RESULT_CACHE_MB"))!=NULL)
+        m_maxBytes=uint64_t(strtoull(str, NULL, 10))<<20;
+      if((str=getenv("HPCE_RESULT_CACHE_EXECUTE"))!=NULL)
+        m_cacheExecute=atoi(str)!=0;
+#endif
+    }
+
+    bool Enabled() const
+    { return !m_dir.empty(); }
+
+    //! True if outputs of the reference (or of Execute) should be looked up and stored
+    bool Covers(bool isReference) const
+    { return Enabled() && (isReference || m_cacheExecute); }
+
+    /* The id of the reference, or of the user's Execute. The reference only
+       changes with the framework headers, so it is their hash; Execute changes
+       with every build, so it is the hash of the running executable. */
+    static std::string ImplementationId(bool isReference)
+    {
+      if(isReference)
+        return std::string("reference.")+PUZZLER_REFERENCE_HASH;
+      Sha256 hash;
+      FILE *exe=fopen("/proc/self/exe", "rb");
+      if(!exe)
+        throw std::runtime_error("ResultCache::ImplementationId - Couldn't read the executable.");
+      std::vector<uint8_t> buffer(size_t(1)<<16);
+      size_t got;
+      while((got=fread(&buffer[0], 1, buffer.size(), exe))>0)
+        hash.Update(&buffer[0], got);
+      fclose(exe);
+      return "execute."+hash.HexDigest();
+    }
+
+    //! The key of input run by implementation
+    std::string Key(const std::string &implementation, Puzzle::Input *input) const
+    {
+      HashStream dst;
+      dst.hash.Update(implementation.c_str(), implementation.size()+1);
+      unsigned version=input->FormatVersion();
+      input->SetFormatVersion(0);
+      try{
+        PersistContext ctxt(&dst, true);
+        input->Persist(ctxt);
+      }catch(...){
+        input->SetFormatVersion(version);
+        throw;
+      }
+      input->SetFormatVersion(version);
+      return dst.hash.HexDigest();
+    }
+
+    //! The output stored under key, in the format of input, or null if there isn't one
+    std::shared_ptr<Puzzle::Output> Load(const std::string &key, const Puzzle::Input *input) const
+    {
+      if(!Enabled())
+        return std::shared_ptr<Puzzle::Output>();
+      std::string path=Path(key);
+      std::shared_ptr<Puzzle::Output> output;
+      try{
+        FileInStream src(path);
+        PersistContext ctxt(&src, false);
+        output=PuzzleRegistrar::LoadOutput(ctxt);
+      }catch(std::exception &){
+        m_log->LogVerbose("ResultCache - No entry %s", key.c_str());
+        return std::shared_ptr<Puzzle::Output>();
+      }
+      if(output->PuzzleName()!=input->PuzzleName()){
+        m_log->LogError("ResultCache - Entry %s is for %s, not %s", key.c_str(),
+                        output->PuzzleName().c_str(), input->PuzzleName().c_str());
+        return std::shared_ptr<Puzzle::Output>();
+      }
+      output->SetFormatVersion(input->FormatVersion());
+#ifdef PUZZLER_HAVE_RESULT_CACHE
+      utimes(path.c_str(), NULL);
+#endif
+      m_log->LogInfo("ResultCache - Hit %s", key.c_str());
+      return output;
+    }
+
+    //! Store output under key; failures are logged rather than thrown
+    void Store(const std::string &key, Puzzle::Output *output) const
+    {
+#ifdef PUZZLER_HAVE_RESULT_CACHE
+      if(!Enabled())
+        return;
+      VectorStream dst;
+      unsigned version=output->FormatVersion();
+      output->SetFormatVersion(0);
+      try{
+        PersistContext ctxt(&dst, true);
+        output->Persist(ctxt);
+      }catch(...){
+        output->SetFormatVersion(version);
+        throw;
+      }
+      output->SetFormatVersion(version);
+
+      // Write to a temporary name then rename, so readers never see part of an entry
+      mkdir(m_dir.c_str(), 0777);
+      std::string path=Path(key);
+      std::stringstream tmp;
+      tmp<<path<<".tmp"<<getpid();
+      FILE *f=fopen(tmp.str().c_str(), "wb");
+      bool ok=f!=NULL;
+      if(f){
+        ok=dst.data.empty() || fwrite(&dst.data[0], dst.data.size(), 1, f)==1;
+        ok=(fclose(f)==0) && ok;
+      }
+      ok=ok && rename(tmp.str().c_str(), path.c_str())==0;
+      if(!ok){
+        unlink(tmp.str().c_str());
+        m_log->LogError("ResultCache - Couldn't write %s", path.c_str());
+        return;
+      }
+      m_log->LogInfo("ResultCache - Stored %s", key.c_str());
+      Evict();
+#else
+      (void)key;
+      (void)output;
+#endif
+    }
+  };
+
+}; // puzzler
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef puzzler_core_spill_file_hpp
+#define puzzler_core_spill_file_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__CYGWIN__) || !(defined(_WIN32) || defined(_WIN64))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PUZZLER_HAVE_SPILL_FILE
+#endif
+
+namespace puzzler{
+
+  /* Data appended to a file as it is produced, then mapped read-only, so an
+     array larger than memory can be built and then paged in from disk as
+     it is used.
+
+     The file is created next to the given path with the process id
+     appended, and unlinked straight away: it is only reachable through the
+     descriptor and the mapping, so concurrent runs never share one and the
+     space is returned when the process exits, however it exits. */
+  class SpillFile
+  {
+  private:
+    // No implementation for either
+    SpillFile(const SpillFile &); // = delete;
+    SpillFile &operator=(const SpillFile &); // = delete;
+
+    // Bytes gathered before each write()
+    static const size_t bufferSize=size_t(1)<<20;
+
+    int m_fd;
+    uint64_t m_size;
+    std::vector<uint8_t> m_buffer;
+    const uint8_t *m_data;
+
+    void Flush()
+    {
+#ifdef PUZZLER_HAVE_SPILL_FILE
+      const uint8_t *p=m_buffer.data();
+      size_t todo=m_buffer.size();
+      while(todo>0){
+        ssize_t done=write(m_fd, p, todo);
+        if(done<=0)
+          throw std::runtime_error("SpillFile::Flush - Couldn't write, is the disk full?");
+        p+=done;
+        todo-=done;
+      }
+#endif
+      m_buffer.clear();
+    }
+  public:
+    //! Advice for the kernel on how the mapped data will be read, or that it won't be again
+    enum Access { Random, HugePages, DontNeed };
+
+    SpillFile(const std::string &path)
+      : m_fd(-1)
+      , m_size(0)
+      , m_data(NULL)
+    {
+#ifdef PUZZLER_HAVE_SPILL_FILE
+      std::string name=path+"."+std::to_string((long long)getpid());
+      m_fd=open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0600);
+      if(m_fd==-1)
+        throw std::runtime_error("SpillFile::SpillFile - Couldn't create '"+name+"'.");
+      unlink(name.c_str());
+      m_buffer.reserve(bufferSize);
+#else
+      throw std::runtime_error("SpillFile::SpillFile - Not supported on this platform.");
+#endif
+    }
+
+    ~SpillFile()
+    {
+#ifdef PUZZLER_HAVE_SPILL_FILE
+      if(m_data)
+        munmap((void*)m_data, m_size);
+      if(m_fd!=-1)
+        close(m_fd);
+#endif
+    }
+
+    void Append(const void *pData, size_t cbData)
+    {
+      if(m_data)
+        throw std::runtime_error("SpillFile::Append - Already mapped.");
+      const uint8_t *p=(const uint8_t*)pData;
+      m_size+=cbData;
+      while(cbData>0){
+        size_t k=std::min(cbData, bufferSize-m_buffer.size());
+        m_buffer.insert(m_buffer.end(), p, p+k);
+        p+=k;
+        cbData-=k;
+        if(m_buffer.size()==bufferSize)
+          Flush();
+      }
+    }
+
+    //! Finish appending and map everything appended
+    void Map()
+    {
+      Flush();
+      std::vector<uint8_t>().swap(m_buffer);
+#ifdef PUZZLER_HAVE_SPILL_FILE
+      if(m_size>0){
+        void *p=mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+        if(p==MAP_FAILED)
+          throw std::runtime_error("SpillFile::Map - Couldn't map the file.");
+        m_data=(const uint8_t*)p;
+      }
+      close(m_fd);
+      m_fd=-1;
+#endif
+    }
+
+    //! The mapped data, or null before Map or if nothing was appended
+    const void *Data() const
+    { return m_data; }
+
+    uint64_t Size() const
+    { return m_size; }
+
+    //! Pass on a hint about the mapped data; returns false if it is unsupported or refused
+    bool Advise(Access access) const
+    { return Advise(m_data, m_size, access); }
+
+    /* The same hint for size bytes at p inside any read-only file mapping,
+       widened to whole pages. */
+    static bool Advise(const void *p, uint64_t size, Access access)
+    {
+#if defined(PUZZLER_HAVE_SPILL_FILE)
+      if(!p || size==0)
+        return false;
+      uintptr_t page=sysconf(_SC_PAGESIZE);
+      uintptr_t begin=uintptr_t(p)/page*page;
+      uintptr_t end=(uintptr_t(p)+size+page-1)/page*page;
+      int advice;
+      switch(access){
+      case Random:    advice=MADV_RANDOM; break;
+#ifdef MADV_HUGEPAGE
+      case HugePages: advice=MADV_HUGEPAGE; break;
+#else
+      case HugePages: return false;
+#endif
+      case DontNeed:  advice=MADV_DONTNEED; break;
+      default:        return false;
+      }
+      return madvise((void*)begin, end-begin, advice)==0;
+#else
+      (void)p;
+      (void)size;
+      (void)access;
+      return false;
+#endif
+    }
+  };
+
+}; // puzzler
+
+#endif
@@ -46,6 +46,25 @@ namespace puzzler{
     virtual void Send(size_t cbData, const void *pData) =0;
     virtual void Recv(size_t cbData, void *pData) =0;
 
+    //! Receive between 1 and cbData bytes, or 0 at the end of the stream
+    virtual size_t RecvSome(size_t cbData, void *pData)
+    {
+      Recv(cbData, pData);
+      return cbData;
+    }
+
+    /*! Receive cbData bytes without copying them, pointing pData at them.
+        The pointer is valid until the next call on the stream. Returns
+        false, consuming nothing, if the stream can't do that here. */
+    virtual bool RecvView(size_t /*cbData*/, const void *&/*pData*/)
+    { return false; }
+
+    /*! As RecvView, but the bytes stay valid for as long as owner is held,
+        even after the stream has gone. Returns false, consuming nothing,
+        unless they lie in a mapped file. */
+    virtual bool RecvMapped(size_t /*cbData*/, const void *&/*pData*/, std::shared_ptr<const void> &/*owner*/)
+    { return false; }
+
     //! Return the current offset from some arbitrary starting point
     virtual uint64_t SendOffset() const =0;
     virtual uint64_t RecvOffset() const =0;
@@ -0,0 +1,197 @@
+#ifndef  puzzler_core_streams_buffered_hpp
+#define  puzzler_core_streams_buffered_hpp
+
+#include "puzzler/core/stream.hpp"
+
+namespace puzzler{
+
+  /* Wraps another stream with one large buffer in each direction, so the
+     many small Send and Recv calls made by PersistContext become a few big
+     reads and writes.
+
+     Reads fill the buffer with whatever the inner stream has, up to the
+     buffer size, so it may read ahead of what has been received. Writes are
+     passed on when the buffer fills, on Flush, and on destruction. The
+     offsets count what the caller has sent and received, not what has gone
+     through the inner stream. */
+  class BufferedStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    BufferedStream(const BufferedStream &); // = delete;
+    BufferedStream &operator=(const BufferedStream &); // = delete;
+
+    static const size_t alignment=4096;
+
+    Stream *m_pInner;
+    size_t m_size;
+
+    std::vector<uint8_t> m_recvBacking, m_sendBacking;
+    uint8_t *m_recvBuffer, *m_sendBuffer;
+    size_t m_recvBegin, m_recvEnd;
+    size_t m_sendEnd;
+
+    uint64_t m_recvOffset, m_sendOffset;
+
+    // Start of an aligned buffer of m_size bytes inside backing
+    uint8_t *Allocate(std::vector<uint8_t> &backing)
+    {
+      backing.resize(m_size+alignment);
+      uintptr_t p=(uintptr_t)&backing[0];
+      return (uint8_t*)((p+alignment-1)/alignment*alignment);
+    }
+  public:
+    BufferedStream(Stream *pInner, size_t size=size_t(1)<<20)
+      : m_pInner(pInner)
+      , m_size(size)
+      , m_recvBuffer(NULL)
+      , m_sendBuffer(NULL)
+      , m_recvBegin(0)
+      , m_recvEnd(0)
+      , m_sendEnd(0)
+      , m_recvOffset(0)
+      , m_sendOffset(0)
+    {
+      if(m_size==0)
+        throw std::runtime_error("BufferedStream - buffer size must be positive.");
+    }
+
+    ~BufferedStream()
+    {
+      // Errors can't escape a destructor; call Flush to see them
+      try{
+        Flush();
+      }catch(...){
+      }
+    }
+
+    //! Pass on everything sent so far
+    void Flush()
+    {
+      if(m_sendEnd>0){
+        size_t n=m_sendEnd;
+        m_sendEnd=0;
+        m_pInner->Send(n, m_sendBuffer);
+      }
+    }
+
+    virtual void Send(size_t cbData, const void *pData)
+    {
+      if(!m_sendBuffer)
+        m_sendBuffer=Allocate(m_sendBacking);
+      m_sendOffset+=cbData;
+      if(m_sendEnd+cbData<=m_size){
+        memcpy(m_sendBuffer+m_sendEnd, pData, cbData);
+        m_sendEnd+=cbData;
+        return;
+      }
+      Flush();
+      // Large blocks go straight through rather than via the buffer
+      if(cbData>=m_size){
+        m_pInner->Send(cbData, pData);
+      }else{
+        memcpy(m_sendBuffer, pData, cbData);
+        m_sendEnd=cbData;
+      }
+    }
+
+    virtual void Recv(size_t cbData, void *pData)
+    {
+      // A mapped inner stream needs no buffer
+      const void *view;
+      if(m_recvBegin==m_recvEnd && m_pInner->RecvView(cbData, view)){
+        memcpy(pData, view, cbData);
+        m_recvOffset+=cbData;
+        return;
+      }
+
+      uint8_t *dst=(uint8_t*)pData;
+      m_recvOffset+=cbData;
+      while(cbData>0){
+        if(m_recvBegin==m_recvEnd){
+          // Large blocks are read straight into place
+          if(cbData>=m_size){
+            m_pInner->Recv(cbData, dst);
+            return;
+          }
+          Refill();
+        }
+        size_t n=std::min(cbData, m_recvEnd-m_recvBegin);
+        memcpy(dst, m_recvBuffer+m_recvBegin, n);
+        m_recvBegin+=n;
+        dst+=n;
+        cbData-=n;
+      }
+    }
+
+    virtual size_t RecvSome(size_t cbData, void *pData)
+    {
+      if(cbData==0)
+        return 0;
+      if(m_recvBegin==m_recvEnd){
+        if(cbData>=m_size){
+          size_t got=m_pInner->RecvSome(cbData, pData);
+          m_recvOffset+=got;
+          return got;
+        }
+        if(!TryRefill())
+          return 0;
+      }
+      size_t n=std::min(cbData, m_recvEnd-m_recvBegin);
+      memcpy(pData, m_recvBuffer+m_recvBegin, n);
+      m_recvBegin+=n;
+      m_recvOffset+=n;
+      return n;
+    }
+
+    virtual bool RecvView(size_t cbData, const void *&pData)
+    {
+      if(m_recvBegin==m_recvEnd){
+        if(!m_pInner->RecvView(cbData, pData))
+          return false;
+      }else if(m_recvEnd-m_recvBegin>=cbData){
+        pData=m_recvBuffer+m_recvBegin;
+        m_recvBegin+=cbData;
+      }else{
+        return false;
+      }
+      m_recvOffset+=cbData;
+      return true;
+    }
+
+    virtual bool RecvMapped(size_t cbData, const void *&pData, std::shared_ptr<const void> &owner)
+    {
+      if(m_recvBegin!=m_recvEnd || !m_pInner->RecvMapped(cbData, pData, owner))
+        return false;
+      m_recvOffset+=cbData;
+      return true;
+    }
+
+    //! Return the current offset from some arbitrary starting point
+    virtual uint64_t SendOffset() const
+    { return m_sendOffset; }
+
+    virtual uint64_t RecvOffset() const
+    { return m_recvOffset; }
+
+  private:
+    bool TryRefill()
+    {
+      if(!m_recvBuffer)
+        m_recvBuffer=Allocate(m_recvBacking);
+      m_recvBegin=0;
+      m_recvEnd=m_pInner->RecvSome(m_size, m_recvBuffer);
+      return m_recvEnd>0;
+    }
+
+    void Refill()
+    {
+      if(!TryRefill())
+        throw std::runtime_error("BufferedStream::Recv - End of file.");
+    }
+  };
+
+}; // puzzler
+
+#endif
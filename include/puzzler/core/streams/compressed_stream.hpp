@@ -0,0 +1,620 @@
+#ifndef  puzzler_core_streams_compressed_hpp
+#define  puzzler_core_streams_compressed_hpp
+
+#include "puzzler/core/stream.hpp"
+
+#include <algorithm>
+
+namespace puzzler{
+
+  /* Wraps another stream, optionally compressing what is sent, and
+     decompressing what is received if it turns out to be compressed.
+
+     A compressed stream starts with the magic "PZC1", which can't begin an
+     uncompressed one (those start with the big-endian length of the format
+     string). Then come blocks of up to blockSize bytes, each with a 16 byte
+     header (method, parameters and the offset of the first word, then the
+     raw, intermediate and encoded lengths as little-endian words) and the
+     encoded bytes. Each block is coded with whichever method does best on
+     its first sampleSize bytes:
+
+     - Raw: stored as is.
+     - Rle: runs of 3 or more equal bytes become a count and the byte;
+       everything else is stored in literal runs of up to 128 bytes.
+     - Delta: the block as 32-bit words (either byte order), each minus the
+       word 0, 1 or 2 before it, zig-zagged and written as a varint, so
+       sorted, repetitive or small values shrink.
+     - DeltaRle: Delta, then Rle over the varints, for long runs of equal
+       words or equal steps.
+     - Pack: the block as 32-bit words (either byte order), each in just
+       enough bits for the largest, so random ids below a million take 20
+       bits rather than 32. */
+  class CompressedStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    CompressedStream(const CompressedStream &); // = delete;
+    CompressedStream &operator=(const CompressedStream &); // = delete;
+
+    static const size_t blockSize=size_t(1)<<20;
+    static const size_t sampleSize=size_t(16)<<10;
+    static const size_t headerSize=16;
+
+    enum Method{ Raw=0, Rle=1, Delta=2, DeltaRle=3, Pack=4 };
+
+    /* Parameters: the stride in words for Delta, the byte order of the words
+       for Delta and Pack, and the width less one for Pack */
+    static const unsigned strideMask=3;
+    static const unsigned littleEndianWords=4;
+    static const unsigned widthShift=3;
+
+    Stream *m_pInner;
+    bool m_compress;
+
+    // Sending
+    bool m_sentMagic;
+    std::vector<uint8_t> m_sendBlock;
+    std::vector<uint8_t> m_mid, m_encoded;
+
+    // Receiving: 0 until the first receive, then 1 if compressed and 2 if not
+    int m_recvMode;
+    std::vector<uint8_t> m_recvBlock;
+    size_t m_recvBegin;
+
+    uint64_t m_recvOffset, m_sendOffset;
+
+    static const char *Magic()
+    { return "PZC1"; }
+
+    static void PutWord(uint8_t *p, uint32_t x)
+    {
+      p[0]=uint8_t(x); p[1]=uint8_t(x>>8); p[2]=uint8_t(x>>16); p[3]=uint8_t(x>>24);
+    }
+
+    static uint32_t GetWord(const uint8_t *p)
+    { return p[0] | (uint32_t(p[1])<<8) | (uint32_t(p[2])<<16) | (uint32_t(p[3])<<24); }
+
+    static uint32_t LoadWord(const uint8_t *p, bool littleEndian)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      uint32_t x;
+      memcpy(&x, p, 4);
+      return littleEndian ? x : __builtin_bswap32(x);
+#else
+      return littleEndian ? GetWord(p)
+        : (uint32_t(p[0])<<24) | (uint32_t(p[1])<<16) | (uint32_t(p[2])<<8) | p[3];
+#endif
+    }
+
+    static void StoreWord(uint8_t *p, uint32_t x, bool littleEndian)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      if(!littleEndian)
+        x=__builtin_bswap32(x);
+      memcpy(p, &x, 4);
+#else
+      if(littleEndian){
+        PutWord(p, x);
+      }else{
+        p[0]=uint8_t(x>>24); p[1]=uint8_t(x>>16); p[2]=uint8_t(x>>8); p[3]=uint8_t(x);
+      }
+#endif
+    }
+
+    // Largest possible encodings of n bytes
+    static size_t RleBound(size_t n)
+    { return n+n/128+1; }
+
+    static size_t DeltaBound(size_t n)
+    { return n/4*5+4; }
+
+    static size_t PackSize(size_t n, unsigned params)
+    { return (n/4*((params>>widthShift)+1)+7)/8 + n%4; }
+
+    // Encode n bytes into dst, which has RleBound(n) bytes; returns the size
+    static size_t EncodeRle(const uint8_t *src, size_t n, uint8_t *dst)
+    {
+      uint8_t *out=dst;
+      size_t i=0;
+      while(i<n){
+        // Literals up to the next run of three
+        size_t j=i;
+        while(j<n && j-i<128 && !(j+2<n && src[j]==src[j+1] && src[j]==src[j+2]))
+          j++;
+        if(j>i){
+          *out++=uint8_t(j-i-1);
+          memcpy(out, src+i, j-i);
+          out+=j-i;
+          i=j;
+          continue;
+        }
+        size_t k=i+3;
+        while(k<n && k-i<130 && src[k]==src[i])
+          k++;
+        *out++=uint8_t(0x80+(k-i-3));
+        *out++=src[i];
+        i=k;
+      }
+      return out-dst;
+    }
+
+    static void DecodeRle(const uint8_t *src, size_t n, uint8_t *dst, size_t rawLen)
+    {
+      const uint8_t *end=src+n;
+      uint8_t *out=dst, *outEnd=dst+rawLen;
+      while(src<end){
+        unsigned c=*src++;
+        if(c<0x80){
+          size_t len=c+1;
+          if(size_t(end-src)<len || size_t(outEnd-out)<len)
+            throw std::runtime_error("CompressedStream::DecodeRle - Block is corrupt.");
+          memcpy(out, src, len);
+          src+=len;
+          out+=len;
+        }else{
+          size_t len=c-0x80+3;
+          if(src==end || size_t(outEnd-out)<len)
+            throw std::runtime_error("CompressedStream::DecodeRle - Block is corrupt.");
+          memset(out, *src++, len);
+          out+=len;
+        }
+      }
+      if(out!=outEnd)
+        throw std::runtime_error("CompressedStream::DecodeRle - Block is corrupt.");
+    }
+
+    // Encode n bytes into dst, which has DeltaBound(n) bytes; returns the size
+    static size_t EncodeDelta(const uint8_t *src, size_t n, unsigned params, uint8_t *dst)
+    {
+      unsigned stride=params&strideMask;
+      bool le=(params&littleEndianWords)!=0;
+      size_t words=n/4;
+      uint8_t *out=dst;
+      for(size_t i=0; i<words; i++){
+        uint32_t x=LoadWord(src+4*i, le);
+        if(stride && i>=stride)
+          x-=LoadWord(src+4*(i-stride), le);
+        x=(x<<1) ^ uint32_t(-int32_t(x>>31));
+        while(x>=0x80){
+          *out++=uint8_t(x|0x80);
+          x>>=7;
+        }
+        *out++=uint8_t(x);
+      }
+      memcpy(out, src+4*words, n-4*words);
+      return out+(n-4*words)-dst;
+    }
+
+    static void DecodeDelta(const uint8_t *src, size_t n, unsigned params, uint8_t *dst, size_t rawLen)
+    {
+      unsigned stride=params&strideMask;
+      bool le=(params&littleEndianWords)!=0;
+      size_t words=rawLen/4, tail=rawLen-4*words;
+      const uint8_t *end=src+n;
+      for(size_t i=0; i<words; i++){
+        uint32_t x=0;
+        if(src!=end && *src<0x80){
+          // Small steps are the common case
+          x=*src++;
+        }else{
+          for(unsigned shift=0; ; shift+=7){
+            if(src==end || shift>28)
+              throw std::runtime_error("CompressedStream::DecodeDelta - Block is corrupt.");
+            uint8_t b=*src++;
+            x|=uint32_t(b&0x7F)<<shift;
+            if(!(b&0x80))
+              break;
+          }
+        }
+        x=(x>>1) ^ uint32_t(-int32_t(x&1));
+        if(stride && i>=stride)
+          x+=LoadWord(dst+4*(i-stride), le);
+        StoreWord(dst+4*i, x, le);
+      }
+      if(size_t(end-src)!=tail)
+        throw std::runtime_error("CompressedStream::DecodeDelta - Block is corrupt.");
+      memcpy(dst+4*words, src, tail);
+    }
+
+    // Encode n bytes into dst, which has n+8 bytes, setting the width in params; returns the size
+    static size_t EncodePack(const uint8_t *src, size_t n, unsigned &params, uint8_t *dst)
+    {
+      bool le=(params&littleEndianWords)!=0;
+      size_t words=n/4;
+      uint32_t all=0;
+      for(size_t i=0; i<words; i++)
+        all|=LoadWord(src+4*i, le);
+      unsigned width=1;
+      while(width<32 && (all>>width)!=0)
+        width++;
+      params=(params&littleEndianWords) | ((width-1)<<widthShift);
+
+      uint8_t *out=dst;
+      uint64_t acc=0;
+      unsigned bits=0;
+      for(size_t i=0; i<words; i++){
+        acc|=uint64_t(LoadWord(src+4*i, le))<<bits;
+        bits+=width;
+        if(bits>=32){
+          PutWord(out, uint32_t(acc));
+          out+=4;
+          acc>>=32;
+          bits-=32;
+        }
+      }
+      for(; bits>0; bits-=std::min(bits, 8u)){
+        *out++=uint8_t(acc);
+        acc>>=8;
+      }
+      memcpy(out, src+4*words, n-4*words);
+      return out+(n-4*words)-dst;
+    }
+
+    // The length of src has already been checked against PackSize
+    static void DecodePack(const uint8_t *src, size_t n, unsigned params, uint8_t *dst, size_t rawLen)
+    {
+      bool le=(params&littleEndianWords)!=0;
+      unsigned width=(params>>widthShift)+1;
+      uint64_t mask=(uint64_t(1)<<width)-1;
+      size_t words=rawLen/4, tail=rawLen-4*words;
+      const uint8_t *end=src+n-tail;
+      uint64_t acc=0;
+      unsigned bits=0;
+      for(size_t i=0; i<words; i++){
+        if(bits<width){
+          if(end-src>=4){
+            acc|=uint64_t(GetWord(src))<<bits;
+            src+=4;
+            bits+=32;
+          }else{
+            while(bits<width && src<end){
+              acc|=uint64_t(*src++)<<bits;
+              bits+=8;
+            }
+          }
+        }
+        StoreWord(dst+4*i, uint32_t(acc&mask), le);
+        acc>>=width;
+        bits-=width;
+      }
+      memcpy(dst+4*words, end, tail);
+    }
+
+    /* Encode n bytes with method and params into m_encoded, leaving the
+       Delta output in m_mid; returns the encoded size. */
+    size_t Encode(const uint8_t *src, size_t n, Method method, unsigned &params, size_t &midLen)
+    {
+      midLen=0;
+      switch(method){
+      case Rle:
+        m_encoded.resize(RleBound(n));
+        return EncodeRle(src, n, &m_encoded[0]);
+      case Delta:
+        m_encoded.resize(DeltaBound(n));
+        return EncodeDelta(src, n, params, &m_encoded[0]);
+      case DeltaRle:
+        m_mid.resize(DeltaBound(n));
+        midLen=EncodeDelta(src, n, params, &m_mid[0]);
+        m_encoded.resize(RleBound(midLen));
+        return EncodeRle(&m_mid[0], midLen, &m_encoded[0]);
+      case Pack:
+        m_encoded.resize(n+8);
+        return EncodePack(src, n, params, &m_encoded[0]);
+      default:
+        throw std::runtime_error("CompressedStream::Encode - Unknown method.");
+      }
+    }
+
+    static unsigned BitLength(uint32_t x)
+    {
+#if defined(__GNUC__)
+      return x ? 32-__builtin_clz(x) : 0;
+#else
+      unsigned n=0;
+      for(; x; x>>=1)
+        n++;
+      return n;
+#endif
+    }
+
+    /* The offset of the first whole word in the block, 0 to 3. Strings
+       leave the words of v0 streams out of step with the block, so this
+       takes whichever offset makes the words narrowest. */
+    static unsigned ChoosePhase(const uint8_t *src, size_t n)
+    {
+      unsigned best=0;
+      uint64_t bestBits=~uint64_t(0);
+      for(unsigned phase=0; phase<4 && phase+4<=n; phase++){
+        uint64_t bits[2]={0, 0};
+        for(size_t i=phase; i+4<=n; i+=4){
+          for(unsigned le=0; le<2; le++){
+            uint32_t x=LoadWord(src+i, le!=0);
+            bits[le]+=BitLength(x);
+          }
+        }
+        if(std::min(bits[0], bits[1])<bestBits){
+          bestBits=std::min(bits[0], bits[1]);
+          best=phase;
+        }
+      }
+      return best;
+    }
+
+    void SendBlock()
+    {
+      size_t n=m_sendBlock.size();
+      if(n==0)
+        return;
+      if(!m_sentMagic){
+        m_pInner->Send(4, Magic());
+        m_sentMagic=true;
+      }
+
+      // Choose the method by trying them all on the start of the block
+      const uint8_t *src=&m_sendBlock[0];
+      size_t sample=std::min(n, size_t(sampleSize));
+      unsigned phase=ChoosePhase(src, sample);
+      Method bestMethod=Raw;
+      unsigned bestParams=0;
+      size_t bestSize=sample-phase, midLen;
+      for(int m=Rle; m<=Pack; m++){
+        for(unsigned tryParams=0; tryParams<(m==Rle ? 1u : 8u); tryParams++){
+          if((tryParams&strideMask)==3 || (m==Pack && (tryParams&strideMask)!=0))
+            continue;
+          unsigned params=tryParams;
+          size_t size=Encode(src+phase, sample-phase, Method(m), params, midLen);
+          if(size<bestSize){
+            bestSize=size;
+            bestMethod=Method(m);
+            bestParams=params;
+          }
+        }
+      }
+
+      // The bytes before the phase are sent as they are, ahead of the rest
+      size_t encLen=n;
+      midLen=0;
+      if(bestMethod!=Raw){
+        size_t size=Encode(src+phase, n-phase, bestMethod, bestParams, midLen);
+        if(phase+size<n){
+          encLen=phase+size;
+        }else{
+          bestMethod=Raw;
+        }
+      }
+      if(bestMethod==Raw){
+        phase=0;
+        bestParams=0;
+        midLen=0;
+      }
+
+      uint8_t header[headerSize]={0};
+      header[0]=uint8_t(bestMethod);
+      header[1]=uint8_t(bestParams);
+      header[2]=uint8_t(phase);
+      PutWord(header+4, n);
+      PutWord(header+8, midLen);
+      PutWord(header+12, encLen);
+      m_pInner->Send(headerSize, header);
+      if(bestMethod==Raw){
+        m_pInner->Send(n, src);
+      }else{
+        m_pInner->Send(phase, src);
+        m_pInner->Send(encLen-phase, &m_encoded[0]);
+      }
+      m_sendBlock.clear();
+    }
+
+    // Decode the next block into m_recvBlock, or return false at the end of the stream
+    bool RecvBlock()
+    {
+      uint8_t header[headerSize];
+      size_t got=0;
+      while(got<headerSize){
+        size_t n=m_pInner->RecvSome(headerSize-got, header+got);
+        if(n==0){
+          if(got==0)
+            return false;
+          throw std::runtime_error("CompressedStream::RecvBlock - Truncated block header.");
+        }
+        got+=n;
+      }
+      unsigned method=header[0], params=header[1], phase=header[2];
+      size_t rawLen=GetWord(header+4), midLen=GetWord(header+8), encLen=GetWord(header+12);
+      if(method>Pack || rawLen>blockSize || phase>=4 || phase>rawLen || phase>encLen
+         || encLen>std::max(RleBound(DeltaBound(rawLen)), rawLen)
+         || midLen>DeltaBound(rawLen) || (params&strideMask)==3
+         || (method==Raw && (encLen!=rawLen || phase!=0))
+         || (method==Pack && encLen!=phase+PackSize(rawLen-phase, params)))
+        throw std::runtime_error("CompressedStream::RecvBlock - Block header is corrupt.");
+
+      m_recvBlock.resize(rawLen);
+      m_recvBegin=0;
+      m_encoded.resize(encLen);
+      if(encLen>0)
+        m_pInner->Recv(encLen, &m_encoded[0]);
+      if(rawLen==0)
+        return true;
+      if(method==Raw){
+        m_recvBlock.swap(m_encoded);
+        return true;
+      }
+
+      memcpy(&m_recvBlock[0], &m_encoded[0], phase);
+      const uint8_t *src=&m_encoded[0]+phase;
+      uint8_t *dst=&m_recvBlock[0]+phase;
+      switch(method){
+      case Rle:
+        DecodeRle(src, encLen-phase, dst, rawLen-phase);
+        break;
+      case Delta:
+        DecodeDelta(src, encLen-phase, params, dst, rawLen-phase);
+        break;
+      case DeltaRle:
+        m_mid.resize(midLen);
+        DecodeRle(src, encLen-phase, &m_mid[0], midLen);
+        DecodeDelta(&m_mid[0], midLen, params, dst, rawLen-phase);
+        break;
+      case Pack:
+        DecodePack(src, encLen-phase, params, dst, rawLen-phase);
+        break;
+      }
+      return true;
+    }
+
+    // Look at the start of the stream to see if it is compressed
+    void DetectMode()
+    {
+      if(m_recvMode!=0)
+        return;
+      uint8_t magic[4];
+      m_pInner->Recv(4, magic);
+      if(!memcmp(magic, Magic(), 4)){
+        m_recvMode=1;
+        m_recvBlock.clear();
+      }else{
+        // Hand back what was read as if it were a block
+        m_recvMode=2;
+        m_recvBlock.assign(magic, magic+4);
+      }
+      m_recvBegin=0;
+    }
+
+    size_t Buffered() const
+    { return m_recvBlock.size()-m_recvBegin; }
+  public:
+    CompressedStream(Stream *pInner, bool compress)
+      : m_pInner(pInner)
+      , m_compress(compress)
+      , m_sentMagic(false)
+      , m_recvMode(0)
+      , m_recvBegin(0)
+      , m_recvOffset(0)
+      , m_sendOffset(0)
+    {
+      if(m_compress)
+        m_sendBlock.reserve(blockSize);
+    }
+
+    ~CompressedStream()
+    {
+      // Errors can't escape a destructor; call Flush to see them
+      try{
+        Flush();
+      }catch(...){
+      }
+    }
+
+    //! True if HPCE_COMPRESS asks for output to be compressed
+    static bool Requested()
+    {
+      const char *str=getenv("HPCE_COMPRESS");
+      return str && atoi(str);
+    }
+
+    //! Code and pass on everything sent so far
+    void Flush()
+    {
+      if(m_compress)
+        SendBlock();
+    }
+
+    virtual void Send(size_t cbData, const void *pData)
+    {
+      m_sendOffset+=cbData;
+      if(!m_compress){
+        m_pInner->Send(cbData, pData);
+        return;
+      }
+      const uint8_t *src=(const uint8_t*)pData;
+      while(cbData>0){
+        size_t n=std::min(cbData, size_t(blockSize)-m_sendBlock.size());
+        m_sendBlock.insert(m_sendBlock.end(), src, src+n);
+        src+=n;
+        cbData-=n;
+        if(m_sendBlock.size()==blockSize)
+          SendBlock();
+      }
+    }
+
+    virtual void Recv(size_t cbData, void *pData)
+    {
+      DetectMode();
+      uint8_t *dst=(uint8_t*)pData;
+      m_recvOffset+=cbData;
+      while(cbData>0){
+        if(Buffered()==0){
+          if(m_recvMode==2){
+            m_pInner->Recv(cbData, dst);
+            return;
+          }
+          if(!RecvBlock())
+            throw std::runtime_error("CompressedStream::Recv - End of file.");
+          continue;
+        }
+        size_t n=std::min(cbData, Buffered());
+        memcpy(dst, &m_recvBlock[m_recvBegin], n);
+        m_recvBegin+=n;
+        dst+=n;
+        cbData-=n;
+      }
+    }
+
+    virtual size_t RecvSome(size_t cbData, void *pData)
+    {
+      if(cbData==0)
+        return 0;
+      DetectMode();
+      while(Buffered()==0){
+        if(m_recvMode==2){
+          size_t got=m_pInner->RecvSome(cbData, pData);
+          m_recvOffset+=got;
+          return got;
+        }
+        if(!RecvBlock())
+          return 0;
+      }
+      size_t n=std::min(cbData, Buffered());
+      memcpy(pData, &m_recvBlock[m_recvBegin], n);
+      m_recvBegin+=n;
+      m_recvOffset+=n;
+      return n;
+    }
+
+    virtual bool RecvView(size_t cbData, const void *&pData)
+    {
+      DetectMode();
+      if(Buffered()==0){
+        if(m_recvMode!=2 || !m_pInner->RecvView(cbData, pData))
+          return false;
+      }else if(Buffered()>=cbData){
+        pData=&m_recvBlock[m_recvBegin];
+        m_recvBegin+=cbData;
+      }else{
+        return false;
+      }
+      m_recvOffset+=cbData;
+      return true;
+    }
+
+    virtual bool RecvMapped(size_t cbData, const void *&pData, std::shared_ptr<const void> &owner)
+    {
+      DetectMode();
+      if(Buffered()!=0 || m_recvMode!=2 || !m_pInner->RecvMapped(cbData, pData, owner))
+        return false;
+      m_recvOffset+=cbData;
+      return true;
+    }
+
+    //! Return the current offset from some arbitrary starting point
+    virtual uint64_t SendOffset() const
+    { return m_sendOffset; }
+
+    virtual uint64_t RecvOffset() const
+    { return m_recvOffset; }
+  };
+
+}; // puzzler
+
+#endif
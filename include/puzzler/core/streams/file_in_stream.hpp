@@ -2,6 +2,7 @@
 #define  puzzler_core_streams_file_hpp
 
 #include "puzzler/core/stream.hpp"
+#include "puzzler/core/streams/mapped_input.hpp"
 
 namespace puzzler{
 
@@ -16,14 +17,19 @@ namespace puzzler{
     uint64_t m_offset;
     
     int m_fd;
+
+    // The file mapped into memory if it could be, shared with the holders of views from RecvMapped
+    std::shared_ptr<MappedInput> m_map;
   public:
     FileInStream(std::string path)
       : m_offset(0)
       , m_fd(-1)
+      , m_map(std::make_shared<MappedInput>())
     {
       m_fd=open(path.c_str(), O_RDONLY);
       if(m_fd==-1)
         throw std::runtime_error("FileStream - Couldn't open file '"+path+"'");
+      m_map->Map(m_fd);
     }
     
     ~FileInStream()
@@ -41,12 +47,48 @@ namespace puzzler{
 
     virtual void Recv(size_t cbData, void *pData)
     {
+      if(m_map->IsMapped()){
+        if(m_map->Read(cbData, pData)!=cbData)
+          throw std::runtime_error("FileInStream::Recv - Not all data was recieved.");
+        m_offset+=cbData;
+        return;
+      }
       int got=read(m_fd, pData, cbData);
       if(got!=(int)cbData)
         throw std::runtime_error("FileInStream::Recv - Not all data was recieved.");
       m_offset+=got;
     }
 
+    virtual size_t RecvSome(size_t cbData, void *pData)
+    {
+      if(m_map->IsMapped()){
+        size_t got=m_map->Read(cbData, pData);
+        m_offset+=got;
+        return got;
+      }
+      int got=read(m_fd, pData, cbData);
+      if(got<0)
+        throw std::runtime_error("FileInStream::RecvSome - Error while reading.");
+      m_offset+=got;
+      return got;
+    }
+
+    virtual bool RecvView(size_t cbData, const void *&pData)
+    {
+      if(!m_map->IsMapped() || !m_map->View(cbData, pData))
+        return false;
+      m_offset+=cbData;
+      return true;
+    }
+
+    virtual bool RecvMapped(size_t cbData, const void *&pData, std::shared_ptr<const void> &owner)
+    {
+      if(!RecvView(cbData, pData))
+        return false;
+      owner=m_map;
+      return true;
+    }
+
     //! Return the current offset from some arbitrary starting point
     virtual uint64_t SendOffset() const
     { return 0; }
@@ -0,0 +1,106 @@
+#ifndef  puzzler_core_streams_mapped_input_hpp
+#define  puzzler_core_streams_mapped_input_hpp
+
+#include "puzzler/core/stream.hpp"
+
+#include <algorithm>
+
+#if defined(__CYGWIN__) || !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#include <unistd.h>
+#define PUZZLER_HAVE_MMAP
+#endif
+
+namespace puzzler{
+
+  /* The rest of a regular file, memory mapped, for the input streams to
+     read from without a read() per call. Map fails cleanly for anything that
+     can't be mapped (pipes, terminals, empty files), and the stream then
+     keeps using read(). */
+  class MappedInput
+  {
+  private:
+    // No implementation for either
+    MappedInput(const MappedInput &); // = delete;
+    MappedInput &operator=(const MappedInput &); // = delete;
+
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos;
+  public:
+    MappedInput()
+      : m_data(NULL)
+      , m_size(0)
+      , m_pos(0)
+    {}
+
+    ~MappedInput()
+    {
+#ifdef PUZZLER_HAVE_MMAP
+      if(m_data)
+        munmap((void*)m_data, m_size);
+#endif
+    }
+
+    //! Map fd, starting at its current file offset
+    bool Map(int fd)
+    {
+#ifdef PUZZLER_HAVE_MMAP
+      struct stat st;
+      if(fstat(fd, &st)!=0 || !S_ISREG(st.st_mode) || st.st_size==0)
+        return false;
+      off_t start=lseek(fd, 0, SEEK_CUR);
+      if(start<0 || start>=st.st_size)
+        return false;
+      int flags=MAP_PRIVATE;
+#ifdef MAP_POPULATE
+      // Fault the whole file in up front, as it will all be read
+      flags|=MAP_POPULATE;
+#endif
+      void *p=mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+      if(p==MAP_FAILED)
+        return false;
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      m_data=(const uint8_t*)p;
+      m_size=st.st_size;
+      m_pos=start;
+      return true;
+#else
+      (void)fd;
+      return false;
+#endif
+    }
+
+    bool IsMapped() const
+    { return m_data!=NULL; }
+
+    //! Offset in the file of the next byte
+    size_t Position() const
+    { return m_pos; }
+
+    size_t Remaining() const
+    { return m_size-m_pos; }
+
+    //! Point at the next cbData bytes and consume them, or return false if there aren't that many
+    bool View(size_t cbData, const void *&pData)
+    {
+      if(cbData>Remaining())
+        return false;
+      pData=m_data+m_pos;
+      m_pos+=cbData;
+      return true;
+    }
+
+    //! Copy up to cbData bytes, returning how many
+    size_t Read(size_t cbData, void *pData)
+    {
+      size_t n=std::min(cbData, Remaining());
+      memcpy(pData, m_data+m_pos, n);
+      m_pos+=n;
+      return n;
+    }
+  };
+
+}; // puzzler
+
+#endif
@@ -2,6 +2,7 @@
 #define  puzzler_core_streams_stdin_hpp
 
 #include "puzzler/core/stream.hpp"
+#include "puzzler/core/streams/mapped_input.hpp"
 
 namespace puzzler{
 
@@ -16,10 +17,26 @@ namespace puzzler{
     uint64_t m_offset;
 
     WithBinaryIO m_withBinary;
+
+    /* Stdin mapped into memory when it is redirected from a regular file.
+       Shared with the holders of views from RecvMapped. */
+    std::shared_ptr<MappedInput> m_map;
   public:
     StdinStream()
       : m_offset(0)
-    {}
+      , m_map(std::make_shared<MappedInput>())
+    {
+      m_map->Map(STDIN_FILENO);
+    }
+
+    ~StdinStream()
+    {
+      // Leave the file offset just after what was received, as read() would
+#ifdef PUZZLER_HAVE_MMAP
+      if(m_map->IsMapped())
+        lseek(STDIN_FILENO, m_map->Position(), SEEK_SET);
+#endif
+    }
 
     virtual void Send(size_t , const void *)
     {
@@ -28,6 +45,12 @@ namespace puzzler{
 
     virtual void Recv(size_t cbData, void *pData)
     {
+      if(m_map->IsMapped()){
+        if(m_map->Read(cbData, pData)!=cbData)
+          throw std::runtime_error("StdoutStream::Recv - End of file.");
+        m_offset+=cbData;
+        return;
+      }
       int got;
       do{
         got=read(STDIN_FILENO, pData, cbData);
@@ -41,6 +64,35 @@ namespace puzzler{
       }while(cbData>0);
     }
 
+    virtual size_t RecvSome(size_t cbData, void *pData)
+    {
+      if(m_map->IsMapped()){
+        size_t got=m_map->Read(cbData, pData);
+        m_offset+=got;
+        return got;
+      }
+      int got=read(STDIN_FILENO, pData, cbData);
+      if(got<0)
+        throw std::runtime_error("StdinStream::RecvSome - Error while reading.");
+      m_offset+=got;
+      return got;
+    }
+
+    virtual bool RecvView(size_t cbData, const void *&pData)
+    {
+      if(!m_map->IsMapped() || !m_map->View(cbData, pData))
+        return false;
+      m_offset+=cbData;
+      return true;
+    }
+
+    virtual bool RecvMapped(size_t cbData, const void *&pData, std::shared_ptr<const void> &owner)
+    {
+      if(!RecvView(cbData, pData))
+        return false;
+      owner=m_map;
+      return true;
+    }
 
     //! Return the current offset from some arbitrary starting point
     virtual uint64_t SendOffset() const
@@ -5,5 +5,8 @@
 #include "puzzler/core/streams/stdin_stream.hpp"
 #include "puzzler/core/streams/stdout_stream.hpp"
 #include "puzzler/core/streams/file_in_stream.hpp"
+#include "puzzler/core/streams/buffered_stream.hpp"
+#include "puzzler/core/streams/compressed_stream.hpp"
+#include "puzzler/core/result_cache.hpp"
 
 #endif
@@ -147,6 +147,29 @@ namespace puzzler
     virtual std::string Name() const override
     { return "logic_sim"; }
 
+    //! Run the netlist of input from each of the initial states, giving one output per state
+    /*! The default just calls Execute once per state, implementations can
+        override it to simulate many states at once. clockCycles and the
+        netlist are taken from input, its inputState is ignored. */
+    virtual std::vector<std::shared_ptr<LogicSimOutput> > ExecuteBatch(
+                                                                  ILog *log,
+                                                                  const LogicSimInput *input,
+                                                                  const std::vector<std::vector<bool> > &inputStates
+                                                                  ) const
+    {
+      std::vector<std::shared_ptr<LogicSimOutput> > outputs;
+      LogicSimInput tmp(*input);
+      for(unsigned i=0; i<inputStates.size(); i++){
+        if(inputStates[i].size()!=input->flipFlopInputs.size())
+          throw std::runtime_error("LogicSimPuzzle::ExecuteBatch - state size is inconsistent.");
+        tmp.inputState=inputStates[i];
+        auto output=std::make_shared<LogicSimOutput>(this, &tmp);
+        Execute(log, &tmp, output.get());
+        outputs.push_back(output);
+      }
+      return outputs;
+    }
+
     virtual std::shared_ptr<Input> CreateInput(
 					       ILog *,
 					       int scale
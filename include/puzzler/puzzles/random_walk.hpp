@@ -4,8 +4,11 @@
 #include <random>
 #include <sstream>
 #include <algorithm>
+#include <thread>
 
 #include "puzzler/core/puzzle.hpp"
+#include "puzzler/core/mt19937.hpp"
+#include "puzzler/core/spill_file.hpp"
 
 namespace puzzler
 {
@@ -36,14 +39,44 @@ namespace puzzler
     uint32_t numSamples;
     uint32_t lengthWalks;
 
-    std::vector<dd_node_t> nodes;
+    /* The graph in compressed sparse row form: the edges of node i are
+       graphEdges[graphOffsets[i]] to graphEdges[graphOffsets[i+1]-1], and
+       its count is nodeCounts[i]. The v0 encoding sends it as a dd_node_t
+       per node, which is converted as it arrives, so the nodes are never
+       all held at once. */
+    std::vector<uint32_t> graphOffsets;
+    std::vector<uint32_t> graphEdges;
+    std::vector<uint32_t> nodeCounts;
+
+    /* When loaded with a graphEdgePath, the edges are kept out of memory and
+       graphEdges stays empty. A v1 input mapped from a regular file is
+       walked where it lies, graphEdgeView pointing into the mapping that
+       graphEdgeMapping keeps alive. Anything else (pipes, compressed or
+       byte swapped streams, v0) is written to a file next to the path as it
+       arrives, which is then mapped as graphEdgeFile. Edges() finds them
+       any way. Only the offsets and counts stay in memory, so graphs whose
+       edges are larger than memory can be loaded and walked. */
+    std::string graphEdgePath;
+    const uint32_t *graphEdgeView;
+    std::shared_ptr<const void> graphEdgeMapping;
+    std::shared_ptr<SpillFile> graphEdgeFile;
+
+    /* Seed and start node of every sample, drawn from mt19937(seed) in the
+       same order as the reference. Generated on a second thread while the
+       nodes are received, as they only depend on the header. */
+    std::vector<uint32_t> sampleSeeds;
+    std::vector<uint32_t> sampleStarts;
 
     RandomWalkInput(const Puzzle *puzzle, int scale)
       : Puzzle::Input(puzzle, scale)
+      , graphEdgeView(NULL)
     {}
 
-    RandomWalkInput(std::string format, std::string name, PersistContext &ctxt)
+    //! Load an input, keeping the edges out of memory if graphEdgePath is given
+    RandomWalkInput(std::string format, std::string name, PersistContext &ctxt, std::string edgePath=std::string())
       : Puzzle::Input(format, name, ctxt)
+      , graphEdgePath(edgePath)
+      , graphEdgeView(NULL)
     {
       PersistImpl(ctxt);
     }
@@ -53,17 +86,207 @@ namespace puzzler
       conn.SendOrRecv(seed);
       conn.SendOrRecv(numSamples);
       conn.SendOrRecv(lengthWalks);
-      conn.SendOrRecv(nodes);
-
-      for(unsigned i=0; i<nodes.size(); i++){
-        if(nodes[i].id!=i)
-          throw std::runtime_error("RandomWalkInput::Persist - ids are corrupt.");
-        for(unsigned j=0; j<nodes[i].edges.size(); j++){
-          if(nodes[i].edges[j] >= nodes.size())
-            throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+      if(conn.IsNative()){
+        PersistGraph(conn);
+      }else if(conn.IsSending()){
+        SendNodes(conn);
+      }else{
+        // Same layout as SendOrRecv of a vector of dd_node_t, appending each edge list to the graph as it arrives
+        uint32_t n=0;
+        conn.SendOrRecv(n);
+        std::thread sampler;
+        if(n>0)
+          sampler=std::thread([this,n](){ GenerateSamples(n, sampleSeeds, sampleStarts); });
+        try{
+          std::shared_ptr<SpillFile> spill=SpillEdges();
+          graphOffsets.resize(n+1);
+          graphOffsets[0]=0;
+          graphEdges.clear();
+          nodeCounts.resize(n);
+          dd_node_t node;
+          for(unsigned i=0; i<n; i++){
+            conn.SendOrRecv(node);
+            if(node.id!=i)
+              throw std::runtime_error("RandomWalkInput::Persist - ids are corrupt.");
+            if(uint64_t(graphOffsets[i])+node.edges.size() > UINT32_MAX)
+              throw std::runtime_error("RandomWalkInput::Persist - too many edges.");
+            graphOffsets[i+1]=graphOffsets[i]+node.edges.size();
+            nodeCounts[i]=node.count;
+            Validate(i, node.edges.data());
+            if(spill){
+              spill->Append(node.edges.data(), node.edges.size()*sizeof(uint32_t));
+            }else{
+              graphEdges.insert(graphEdges.end(), node.edges.begin(), node.edges.end());
+            }
+          }
+          if(spill){
+            spill->Map();
+            graphEdgeFile=spill;
+          }
+        }catch(...){
+          if(sampler.joinable())
+            sampler.join();
+          throw;
         }
+        if(sampler.joinable())
+          sampler.join();
       }
+    }
+
+    //! Number of nodes in the graph
+    unsigned NodeCount() const
+    { return graphOffsets.empty() ? 0 : graphOffsets.size()-1; }
+
+    //! The edges, from graphEdges or the mapping they were received into
+    const uint32_t *Edges() const
+    {
+      if(graphEdgeView)
+        return graphEdgeView;
+      return graphEdgeFile ? (const uint32_t*)graphEdgeFile->Data() : graphEdges.data();
+    }
+
+    size_t EdgeCount() const
+    { return graphOffsets.empty() ? 0 : graphOffsets.back(); }
+
+    //! True if the edges are paged in from a file rather than held in memory
+    bool EdgesMapped() const
+    { return graphEdgeView || graphEdgeFile; }
+
+    //! Pass on a hint about mapped edges; returns false if they aren't mapped or it is refused
+    bool AdviseEdges(SpillFile::Access access) const
+    {
+      if(graphEdgeFile)
+        return graphEdgeFile->Advise(access);
+      return SpillFile::Advise(graphEdgeView, EdgeCount()*sizeof(uint32_t), access);
+    }
 
+    //! The file to receive edges into, or null to keep them in graphEdges
+    std::shared_ptr<SpillFile> SpillEdges() const
+    {
+      if(graphEdgePath.empty())
+        return std::shared_ptr<SpillFile>();
+      return std::make_shared<SpillFile>(graphEdgePath);
+    }
+
+    /* The native encoding holds the graph as graphOffsets and graphEdges,
+       then nodeCounts, so all three arrive as single blocks and are checked
+       in place. */
+    void PersistGraph(PersistContext &conn)
+    {
+      if(conn.IsSending()){
+        conn.SendOrRecv(graphOffsets);
+        if(EdgesMapped()){
+          conn.SendWords(Edges(), EdgeCount());
+        }else{
+          conn.SendOrRecv(graphEdges);
+        }
+        conn.SendOrRecv(nodeCounts);
+        return;
+      }
+
+      conn.SendOrRecv(graphOffsets);
+      if(graphOffsets.empty() || graphOffsets[0]!=0)
+        throw std::runtime_error("RandomWalkInput::Persist - offsets are corrupt.");
+      unsigned n=NodeCount();
+      for(unsigned i=0; i<n; i++){
+        if(graphOffsets[i]>graphOffsets[i+1])
+          throw std::runtime_error("RandomWalkInput::Persist - offsets are corrupt.");
+        if(graphOffsets[i]==graphOffsets[i+1])
+          throw std::runtime_error("RandomWalkInput::Persist - node has no edges.");
+      }
+
+      std::thread sampler;
+      if(n>0)
+        sampler=std::thread([this,n](){ GenerateSamples(n, sampleSeeds, sampleStarts); });
+      try{
+        size_t edgeCount;
+        if(!graphEdgePath.empty()){
+          // Walked in place when the stream has them mapped, else spilled
+          std::shared_ptr<SpillFile> spill;
+          const uint32_t *view;
+          edgeCount=conn.RecvWordsMapped<uint32_t>(view, graphEdgeMapping, [&](const uint32_t *edges, size_t k){
+            for(size_t j=0; j<k; j++){
+              if(edges[j] >= n)
+                throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+            }
+            if(!spill)
+              spill=SpillEdges();
+            spill->Append(edges, k*sizeof(uint32_t));
+          });
+          graphEdges.clear();
+          if(view){
+            for(size_t j=0; j<edgeCount; j++){
+              if(view[j] >= n)
+                throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+            }
+            graphEdgeView=view;
+          }else if(spill){
+            spill->Map();
+            graphEdgeFile=spill;
+          }
+        }else{
+          conn.SendOrRecv(graphEdges);
+          edgeCount=graphEdges.size();
+          for(size_t j=0; j<edgeCount; j++){
+            if(graphEdges[j] >= n)
+              throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+          }
+        }
+        if(edgeCount!=graphOffsets[n])
+          throw std::runtime_error("RandomWalkInput::Persist - offsets are corrupt.");
+        conn.SendOrRecv(nodeCounts);
+        if(nodeCounts.size()!=n)
+          throw std::runtime_error("RandomWalkInput::Persist - counts are corrupt.");
+      }catch(...){
+        if(sampler.joinable())
+          sampler.join();
+        throw;
+      }
+      if(sampler.joinable())
+        sampler.join();
+    }
+
+    // The v0 encoding, a dd_node_t per node, made from the graph
+    void SendNodes(PersistContext &conn)
+    {
+      uint32_t n=NodeCount();
+      conn.SendOrRecv(n);
+      const uint32_t *edges=Edges();
+      dd_node_t node;
+      for(unsigned i=0; i<n; i++){
+        Validate(i, edges+graphOffsets[i]);
+        node.id=i;
+        node.edges.assign(edges+graphOffsets[i], edges+graphOffsets[i+1]);
+        node.count=nodeCounts[i];
+        conn.SendOrRecv(node);
+      }
+    }
+
+    void GenerateSamples(unsigned nodeCount, std::vector<uint32_t> &seeds, std::vector<uint32_t> &starts) const
+    {
+      // The same sequence as std::mt19937(seed), two outputs per sample
+      std::vector<uint32_t> raw(2*size_t(numSamples));
+      Mt19937Fill(seed, raw.data(), raw.size());
+      seeds.resize(numSamples);
+      starts.resize(numSamples);
+      for(unsigned i=0; i<numSamples; i++){
+        seeds[i]=raw[2*i];
+        starts[i]=raw[2*i+1] % nodeCount;    // Choose a random node
+      }
+    }
+
+    /* Check the edges of node i, given its edge list. A walk reaching a
+       node without edges would have nowhere to go, so every node needs at
+       least one. */
+    void Validate(unsigned i, const uint32_t *edges) const
+    {
+      unsigned n=NodeCount();
+      if(graphOffsets[i]==graphOffsets[i+1])
+        throw std::runtime_error("RandomWalkInput::Persist - node has no edges.");
+      for(unsigned j=0; j<graphOffsets[i+1]-graphOffsets[i]; j++){
+        if(edges[j] >= n)
+          throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+      }
     }
   };
 
@@ -111,17 +334,18 @@ namespace puzzler
   protected:
     /* Start from node start, then follow a random walk of length nodes, incrementing
        the count of all the nodes we visit. */
-    void random_walk(std::vector<dd_node_t> &nodes, uint32_t seed, unsigned start, unsigned length) const
+    void random_walk(const std::vector<uint32_t> &offsets, const uint32_t *edges,
+                     std::vector<uint32_t> &counts, uint32_t seed, unsigned start, unsigned length) const
     {
       uint32_t rng=seed;
       unsigned current=start;
       for(unsigned i=0; i<length; i++){
-        nodes[current].count++;
+        counts[current]++;
 
-        unsigned edgeIndex = rng % nodes[current].edges.size();
+        unsigned edgeIndex = rng % (offsets[current+1]-offsets[current]);
         rng=step(rng);
         
-        current=nodes[current].edges[edgeIndex];
+        current=edges[offsets[current]+edgeIndex];
       }
     }
 
@@ -140,17 +364,21 @@ namespace puzzler
 			  ) const
     {
 
-      // Take a copy, as we'll need to modify the "count" flags
-      std::vector<dd_node_t> nodes(pInput->nodes);
+      const std::vector<uint32_t> &offsets(pInput->graphOffsets);
+      const uint32_t *edges=pInput->Edges();
+      unsigned n=pInput->NodeCount();
+
+      // Take a copy, as we'll need to modify the counts
+      std::vector<uint32_t> counts(pInput->nodeCounts);
       
       log->Log(Log_Debug, [&](std::ostream &dst){
-        dst<<"  Scale = "<<nodes.size()<<"\n";
-        for(unsigned i=0;i<nodes.size();i++){
+        dst<<"  Scale = "<<n<<"\n";
+        for(unsigned i=0;i<n;i++){
           dst<<"  "<<i<<" -> [";
-          for(unsigned j=0;j<nodes[i].edges.size();j++){
-            if(j!=0)
+          for(unsigned j=offsets[i];j<offsets[i+1];j++){
+            if(j!=offsets[i])
               dst<<",";
-            dst<<nodes[i].edges[j];
+            dst<<edges[j];
           }
           dst<<"]\n";
         }
@@ -163,19 +391,18 @@ namespace puzzler
 
       for(unsigned i=0; i<pInput->numSamples; i++){
         unsigned seed=rng();
-        unsigned start=rng() % nodes.size();    // Choose a random node
+        unsigned start=rng() % n;    // Choose a random node
         unsigned length=pInput->lengthWalks;           // All paths the same length
 
-        random_walk(nodes, seed, start, length);
+        random_walk(offsets, edges, counts, seed, start, length);
       }
 
       log->LogVerbose("Done random walks, converting histogram");
 
       // Map the counts from the nodes back into an array
-      pOutput->histogram.resize(nodes.size());
-      for(unsigned i=0; i<nodes.size(); i++){
-        pOutput->histogram[i]=std::make_pair(uint32_t(nodes[i].count),uint32_t(i));
-        nodes[i].count=0;
+      pOutput->histogram.resize(n);
+      for(unsigned i=0; i<n; i++){
+        pOutput->histogram[i]=std::make_pair(uint32_t(counts[i]),uint32_t(i));
       }
       // Order them by how often they were visited
       std::sort(pOutput->histogram.rbegin(), pOutput->histogram.rend());
@@ -208,17 +435,18 @@ namespace puzzler
       params->numSamples=scale;
       params->lengthWalks=scale;
 
-      params->nodes.resize(scale);
+      unsigned degree=1 + unsigned(sqrt(scale));
+      params->graphOffsets.resize(scale+1);
+      params->graphEdges.reserve(size_t(scale)*degree);
+      params->nodeCounts.assign(scale, 0);
+      params->graphOffsets[0]=0;
       for(unsigned i=0; i<(unsigned)scale; i++){
-        unsigned degree=1 + unsigned(sqrt(scale));
-
-        params->nodes[i].id=i;
-        params->nodes[i].count=0;
-        params->nodes[i].edges.reserve(degree);
         for(unsigned j=0; j<degree; j++){
-          params->nodes[i].edges.push_back(rnd()%scale);
+          params->graphEdges.push_back(rnd()%scale);
         }
+        params->graphOffsets[i+1]=params->graphEdges.size();
       }
+      params->GenerateSamples(scale, params->sampleSeeds, params->sampleStarts);
 
       return params;
     }
@@ -0,0 +1,253 @@
+#ifndef disk_cache_hpp
+#define disk_cache_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define DISK_CACHE_MMAP
+#endif
+
+/* Content hash for cache keys. Not cryptographic, but mixes a 64-bit word
+   per step so hashing hundreds of megabytes of input stays cheap. */
+class ContentHash
+{
+public:
+	ContentHash(uint64_t seed = 0)
+		: m_h(0x9e3779b97f4a7c15ull ^ seed)
+		, m_length(0)
+	{}
+
+	ContentHash &add(const void *data, size_t size)
+	{
+		const uint8_t *p = (const uint8_t *)data;
+		m_length += size;
+		for (; size >= 8; size -= 8, p += 8) {
+			uint64_t k;
+			memcpy(&k, p, 8);
+			mix(k);
+		}
+		if (size) {
+			uint64_t k = 0;
+			memcpy(&k, p, size);
+			mix(k ^ (uint64_t(size) << 56));
+		}
+		return *this;
+	}
+
+	template<class T>
+	ContentHash &add(const std::vector<T> &v)
+	{
+		uint64_t n = v.size();
+		add(&n, sizeof(n));
+		return add(v.data(), v.size() * sizeof(T));
+	}
+
+	template<class T>
+	ContentHash &addValue(const T &x)
+	{ return add(&x, sizeof(x)); }
+
+	uint64_t value() const
+	{
+		uint64_t h = m_h ^ m_length;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+private:
+	uint64_t m_h, m_length;
+
+	void mix(uint64_t k)
+	{
+		k *= 0x87c37b91114253d5ull;
+		k = (k << 31) | (k >> 33);
+		k *= 0x4cf5ad432745937full;
+		m_h ^= k;
+		m_h = ((m_h << 27) | (m_h >> 37)) * 5 + 0x52dce729;
+	}
+};
+
+/* Read-only view of a whole file, memory mapped where the platform allows */
+class MappedFile
+{
+public:
+	// Expected use of a range, passed on to the kernel as a hint
+	enum Access { Normal, Sequential, Random, WillNeed, HugePages };
+
+	MappedFile()
+		: m_data(NULL)
+		, m_size(0)
+	{}
+
+	~MappedFile()
+	{ close(); }
+
+	bool open(const std::string &path)
+	{
+		close();
+#ifdef DISK_CACHE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		m_data = (const uint8_t *)p;
+		m_size = st.st_size;
+		return true;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+	void close()
+	{
+#ifdef DISK_CACHE_MMAP
+		if (m_data)
+			munmap((void *)m_data, m_size);
+#endif
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	const uint8_t *data() const
+	{ return m_data; }
+
+	size_t size() const
+	{ return m_size; }
+
+	// Returns false if the hint is unsupported or was refused
+	bool advise(size_t offset, size_t size, Access access) const
+	{
+#ifdef DISK_CACHE_MMAP
+		if (!m_data || offset >= m_size)
+			return false;
+		int advice;
+		switch (access) {
+		case Sequential:	advice = MADV_SEQUENTIAL; break;
+		case Random:		advice = MADV_RANDOM; break;
+		case WillNeed:		advice = MADV_WILLNEED; break;
+#ifdef MADV_HUGEPAGE
+		case HugePages:		advice = MADV_HUGEPAGE; break;
+#else
+		case HugePages:		return false;
+#endif
+		default:		advice = MADV_NORMAL; break;
+		}
+		// madvise wants a page aligned start
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t begin = offset / page * page;
+		size = std::min(size, m_size - offset) + (offset - begin);
+		return madvise((void *)(m_data + begin), size, advice) == 0;
+#else
+		(void)offset;
+		(void)size;
+		(void)access;
+		return false;
+#endif
+	}
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const uint8_t *m_data;
+	size_t m_size;
+};
+
+/* Directory of files named by kind and content key.
+
+   Caching is off unless HPCE_CACHE_DIR names the directory to use. Files
+   are written to a temporary name and renamed into place, so concurrent
+   runs never see a partial entry. */
+class DiskCache
+{
+public:
+	DiskCache()
+	{
+		char *str;
+		if ((str = getenv("HPCE_CACHE_DIR")) != NULL)
+			m_dir = str;
+#ifndef DISK_CACHE_MMAP
+		m_dir.clear();
+#endif
+	}
+
+	bool enabled() const
+	{ return !m_dir.empty(); }
+
+	std::string path(const std::string &kind, uint64_t key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "-%016llx.bin", (unsigned long long)key);
+		return m_dir + "/" + kind + name;
+	}
+
+	bool load(const std::string &kind, uint64_t key, MappedFile &file) const
+	{
+		return enabled() && file.open(path(kind, key));
+	}
+
+	// Write the concatenation of the chunks as one entry
+	bool store(const std::string &kind, uint64_t key,
+			const std::vector<std::pair<const void *, size_t> > &chunks) const
+	{
+		if (!enabled())
+			return false;
+#ifdef DISK_CACHE_MMAP
+		mkdir(m_dir.c_str(), 0777);
+#endif
+		return write(path(kind, key), chunks);
+	}
+
+	// Write the concatenation of the chunks to a temporary name, then rename it to path
+	static bool write(const std::string &final, const std::vector<std::pair<const void *, size_t> > &chunks)
+	{
+#ifdef DISK_CACHE_MMAP
+		std::string tmp = final + ".tmp" + std::to_string((long long)getpid());
+		FILE *f = fopen(tmp.c_str(), "wb");
+		if (!f)
+			return false;
+		bool ok = true;
+		for (const auto &chunk: chunks)
+			ok = ok && (chunk.second == 0 || fwrite(chunk.first, chunk.second, 1, f) == 1);
+		ok = (fclose(f) == 0) && ok;
+		if (ok)
+			ok = rename(tmp.c_str(), final.c_str()) == 0;
+		if (!ok)
+			unlink(tmp.c_str());
+		return ok;
+#else
+		(void)final;
+		(void)chunks;
+		return false;
+#endif
+	}
+
+private:
+	std::string m_dir;
+};
+
+#endif
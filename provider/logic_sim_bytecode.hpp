@@ -0,0 +1,136 @@
+#ifndef logic_sim_bytecode_hpp
+#define logic_sim_bytecode_hpp
+
+#include <algorithm>
+#include <vector>
+
+#include "logic_sim_netlist.hpp"
+
+/* Straight-line program compiled from a LogicSimNetlist.
+
+   Every gate becomes one "r[dst] = r[a] ^ r[b]" instruction over a small
+   register file. Registers 0..flipFlopCount-1 hold the flip-flop state, and
+   the remaining registers are reused as soon as the last reader of a gate
+   has executed, so the working set stays far smaller than one slot per
+   gate. Operands are 16 bits wide whenever the register file allows it. */
+class LogicSimProgram
+{
+public:
+	unsigned flipFlopCount;
+	unsigned registerCount;
+	// Register holding the next state of each flip-flop after the program
+	std::vector<uint32_t> outputs;
+
+	LogicSimProgram()
+		: flipFlopCount(0)
+		, registerCount(0)
+	{}
+
+	explicit LogicSimProgram(const LogicSimNetlist &netlist)
+		: LogicSimProgram()
+	{
+		compile(netlist);
+	}
+
+	unsigned opCount() const
+	{ return (m_ops16.size() + m_ops32.size()) / 3; }
+
+	void compile(const LogicSimNetlist &netlist)
+	{
+		unsigned ff = netlist.flipFlopCount;
+		unsigned gates = netlist.gateCount();
+		unsigned values = netlist.valueCount();
+		const uint32_t never = ~0u;
+
+		// Backwards liveness: gates outside every flip-flop cone are never read
+		std::vector<bool> live(values, false);
+		for (uint32_t src: netlist.flipFlopSrc)
+			live[src] = true;
+		for (unsigned g = gates; g-- != 0; ) {
+			if (live[ff + g]) {
+				live[netlist.gateSrc1[g]] = true;
+				live[netlist.gateSrc2[g]] = true;
+			}
+		}
+
+		// Last gate reading each value, flip-flop sources live to the end
+		std::vector<uint32_t> lastUse(values, never);
+		for (unsigned g = 0; g != gates; g++) {
+			if (live[ff + g]) {
+				lastUse[netlist.gateSrc1[g]] = g;
+				lastUse[netlist.gateSrc2[g]] = g;
+			}
+		}
+		for (uint32_t src: netlist.flipFlopSrc)
+			lastUse[src] = gates;
+
+		// Linear scan allocation in evaluation order
+		flipFlopCount = ff;
+		registerCount = ff;
+		std::vector<uint32_t> reg(values, never), free;
+		for (unsigned i = 0; i != ff; i++)
+			reg[i] = i;
+		std::vector<uint32_t> ops;
+		ops.reserve(3 * gates);
+		for (unsigned g = 0; g != gates; g++) {
+			uint32_t v = ff + g;
+			if (!live[v])
+				continue;
+
+			uint32_t a = netlist.gateSrc1[g], b = netlist.gateSrc2[g];
+			ops.push_back(0);
+			ops.push_back(reg[a]);
+			ops.push_back(reg[b]);
+			// Sources dying here can be overwritten by this gate
+			if (a >= ff && lastUse[a] == g)
+				free.push_back(reg[a]);
+			if (b >= ff && b != a && lastUse[b] == g)
+				free.push_back(reg[b]);
+
+			if (free.empty()) {
+				reg[v] = registerCount++;
+			} else {
+				reg[v] = free.back();
+				free.pop_back();
+			}
+			ops[ops.size() - 3] = reg[v];
+		}
+
+		outputs.resize(ff);
+		for (unsigned i = 0; i != ff; i++)
+			outputs[i] = reg[netlist.flipFlopSrc[i]];
+
+		m_ops16.clear();
+		m_ops32.clear();
+		if (registerCount <= 0x10000)
+			m_ops16.assign(ops.begin(), ops.end());
+		else
+			m_ops32.swap(ops);
+	}
+
+	// One clock cycle; regs must hold registerCount entries, next flipFlopCount
+	void step(uint8_t *regs, uint8_t *next) const
+	{
+		if (!m_ops16.empty())
+			run(m_ops16.data(), m_ops16.size(), regs);
+		else
+			run(m_ops32.data(), m_ops32.size(), regs);
+
+		for (unsigned i = 0; i != flipFlopCount; i++)
+			next[i] = regs[outputs[i]];
+		std::copy(next, next + flipFlopCount, regs);
+	}
+
+private:
+	std::vector<uint16_t> m_ops16;
+	std::vector<uint32_t> m_ops32;
+
+	template<class I>
+	static void run(const I *ops, size_t n, uint8_t *regs)
+	{
+		for (const I *end = ops + n; ops != end; ops += 3)
+			regs[ops[0]] = regs[ops[1]] ^ regs[ops[2]];
+	}
+};
+
+#endif
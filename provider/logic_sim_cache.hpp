@@ -0,0 +1,159 @@
+#ifndef logic_sim_cache_hpp
+#define logic_sim_cache_hpp
+
+#include <cstring>
+#include <vector>
+
+#include "puzzler/puzzles/logic_sim.hpp"
+#include "disk_cache.hpp"
+#include "logic_sim_netlist.hpp"
+#include "logic_sim_optimise.hpp"
+
+// provider/makefile defines this as a hash of the netlist compiler sources
+#ifndef LOGIC_SIM_SOURCE_HASH
+#define LOGIC_SIM_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+/* On-disk cache of optimised and levelised netlists.
+
+   Entries are keyed by a hash of the gate and flip-flop inputs together with
+   LOGIC_SIM_SOURCE_HASH, the toolchain version and whether the netlist is
+   reordered, so editing the compiler or changing any of them simply misses
+   the old entries. An entry is a fixed header followed by the netlist
+   arrays, and is read back through a memory mapping. Entries are checked to
+   describe a well formed netlist for the input before being used, so a
+   corrupt or colliding file is ignored rather than read out of bounds. */
+class LogicSimNetlistCache
+{
+public:
+	struct Stats
+	{
+		uint32_t gatesBefore, gatesAfter;
+		uint32_t deadGates, foldedGates, sharedGates;
+	};
+
+	LogicSimNetlistCache(const puzzler::LogicSimInput *input, bool reordered)
+		: m_flipFlops(input->flipFlopInputs.size())
+	{
+		m_key = ContentHash()
+				.add(LOGIC_SIM_SOURCE_HASH, sizeof(LOGIC_SIM_SOURCE_HASH))
+				.add(__VERSION__, sizeof(__VERSION__))
+				.addValue(reordered)
+				.add(input->xorGateInputs)
+				.add(input->flipFlopInputs)
+				.value();
+	}
+
+	bool enabled() const
+	{ return m_cache.enabled(); }
+
+	uint64_t key() const
+	{ return m_key; }
+
+	bool load(LogicSimNetlist &netlist, Stats &stats) const
+	{
+		MappedFile file;
+		if (!m_cache.load("logic_sim", m_key, file) || file.size() < sizeof(Header))
+			return false;
+		Header h;
+		memcpy(&h, file.data(), sizeof(h));
+		if (memcmp(h.magic, magic(), sizeof(h.magic)) || h.key != m_key || h.flipFlops != m_flipFlops)
+			return false;
+		size_t words = 2 * size_t(h.gates) + (size_t(h.levels) + 1) + 2 * size_t(h.flipFlops);
+		if (file.size() != sizeof(Header) + words * sizeof(uint32_t))
+			return false;
+
+		const uint32_t *p = (const uint32_t *)(file.data() + sizeof(Header));
+		if (!valid(h, p))
+			return false;
+		netlist.flipFlopCount = h.flipFlops;
+		netlist.gateSrc1.assign(p, p + h.gates);
+		p += h.gates;
+		netlist.gateSrc2.assign(p, p + h.gates);
+		p += h.gates;
+		netlist.levels.assign(p, p + h.levels + 1);
+		p += h.levels + 1;
+		netlist.flipFlopSrc.assign(p, p + h.flipFlops);
+		p += h.flipFlops;
+		netlist.flipFlopOrigin.assign(p, p + h.flipFlops);
+		stats = h.stats;
+		return true;
+	}
+
+	bool store(const LogicSimNetlist &netlist, const LogicSimOptimiser &optimiser) const
+	{
+		Header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, magic(), sizeof(h.magic));
+		h.flipFlops = netlist.flipFlopCount;
+		h.gates = netlist.gateCount();
+		h.levels = netlist.levelCount();
+		h.stats.gatesBefore = optimiser.gatesBefore;
+		h.stats.gatesAfter = optimiser.gatesAfter;
+		h.stats.deadGates = optimiser.deadGates;
+		h.stats.foldedGates = optimiser.foldedGates;
+		h.stats.sharedGates = optimiser.sharedGates;
+		h.key = m_key;
+
+		std::vector<std::pair<const void *, size_t> > chunks;
+		chunks.push_back(std::make_pair((const void *)&h, sizeof(h)));
+		chunks.push_back(chunk(netlist.gateSrc1));
+		chunks.push_back(chunk(netlist.gateSrc2));
+		chunks.push_back(chunk(netlist.levels));
+		chunks.push_back(chunk(netlist.flipFlopSrc));
+		chunks.push_back(chunk(netlist.flipFlopOrigin));
+		return m_cache.store("logic_sim", m_key, chunks);
+	}
+
+private:
+	static const char *magic()
+	{ return "LSNET\0\0\0"; }
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t flipFlops, gates, levels;
+		Stats stats;
+		uint64_t key;
+	};
+
+	DiskCache m_cache;
+	uint32_t m_flipFlops;
+	uint64_t m_key;
+
+	/* Check the arrays following h describe a netlist the engines can run:
+	   levels partition the gates, a gate only reads flip-flops and gates of
+	   earlier levels, flip-flops read existing values, and flipFlopOrigin is
+	   a permutation. */
+	static bool valid(const Header &h, const uint32_t *p)
+	{
+		const uint32_t *src1 = p, *src2 = p + h.gates;
+		const uint32_t *levels = src2 + h.gates;
+		const uint32_t *ffSrc = levels + h.levels + 1, *ffOrigin = ffSrc + h.flipFlops;
+
+		if (levels[0] != 0 || levels[h.levels] != h.gates)
+			return false;
+		for (unsigned l = 0; l != h.levels; l++) {
+			uint32_t begin = levels[l], end = levels[l + 1];
+			if (end < begin || end > h.gates)
+				return false;
+			uint64_t limit = uint64_t(h.flipFlops) + begin;
+			for (uint32_t g = begin; g != end; g++)
+				if (src1[g] >= limit || src2[g] >= limit)
+					return false;
+		}
+		uint64_t values = uint64_t(h.flipFlops) + h.gates;
+		std::vector<bool> seen(h.flipFlops, false);
+		for (unsigned i = 0; i != h.flipFlops; i++) {
+			if (ffSrc[i] >= values || ffOrigin[i] >= h.flipFlops || seen[ffOrigin[i]])
+				return false;
+			seen[ffOrigin[i]] = true;
+		}
+		return true;
+	}
+
+	static std::pair<const void *, size_t> chunk(const std::vector<uint32_t> &v)
+	{ return std::make_pair((const void *)v.data(), v.size() * sizeof(uint32_t)); }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef logic_sim_cache_model_hpp
+#define logic_sim_cache_model_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "logic_sim_netlist.hpp"
+
+/* Software model of a two level data cache, fed the addresses one levelised
+   sweep reads and writes.
+
+   Used to compare netlist orders where hardware counters (perf stat) are not
+   available, e.g. inside a VM. Both levels are set associative with LRU
+   replacement and 64 byte lines, and every L1 miss is looked up in L2. The
+   defaults are 48 KB 12-way and 2 MB 16-way. The real addresses of the
+   netlist arrays are used, so their alignment is modelled too. */
+class LogicSimCacheModel
+{
+public:
+	uint64_t accesses, l1Misses, l2Misses;
+
+	LogicSimCacheModel(unsigned l1Bytes = 48 << 10, unsigned l1Ways = 12,
+			unsigned l2Bytes = 2 << 20, unsigned l2Ways = 16)
+		: accesses(0)
+		, l1Misses(0)
+		, l2Misses(0)
+		, m_l1(l1Bytes, l1Ways)
+		, m_l2(l2Bytes, l2Ways)
+	{}
+
+	void access(const void *p)
+	{
+		uint64_t line = uint64_t(uintptr_t(p)) >> lineBits;
+		accesses++;
+		if (m_l1.touch(line))
+			return;
+		l1Misses++;
+		if (!m_l2.touch(line))
+			l2Misses++;
+	}
+
+	// One clock cycle of LogicSimNetlist::step on a single thread: each gate
+	// reads its two sources and writes its value, then the flip-flops latch
+	void sweep(const LogicSimNetlist &netlist, const uint8_t *values, const uint8_t *next)
+	{
+		unsigned n = netlist.flipFlopCount;
+		const uint32_t *s1 = netlist.gateSrc1.data(), *s2 = netlist.gateSrc2.data();
+		for (unsigned g = 0; g != netlist.gateCount(); g++) {
+			access(s1 + g);
+			access(s2 + g);
+			access(values + s1[g]);
+			access(values + s2[g]);
+			access(values + n + g);
+		}
+		const uint32_t *src = netlist.flipFlopSrc.data();
+		for (unsigned i = 0; i != n; i++) {
+			access(src + i);
+			access(values + src[i]);
+			access(next + i);
+		}
+		for (unsigned i = 0; i != n; i++) {
+			access(next + i);
+			access(values + i);
+		}
+	}
+
+	void reset()
+	{ accesses = l1Misses = l2Misses = 0; }
+
+private:
+	static const unsigned lineBits = 6;
+
+	// One level: each set holds its lines most recently used first
+	class Level
+	{
+	public:
+		Level(unsigned bytes, unsigned ways)
+			: m_ways(ways)
+			, m_sets(bytes >> lineBits)
+		{
+			m_sets /= ways;
+			m_lines.assign(size_t(m_sets) * ways, ~uint64_t(0));
+		}
+
+		// Returns true on a hit; either way the line becomes most recently used
+		bool touch(uint64_t line)
+		{
+			uint64_t *set = &m_lines[size_t(line % m_sets) * m_ways];
+			unsigned i = 0;
+			while (i != m_ways - 1 && set[i] != line)
+				i++;
+			bool hit = set[i] == line;
+			for (; i > 0; i--)
+				set[i] = set[i - 1];
+			set[0] = line;
+			return hit;
+		}
+
+	private:
+		unsigned m_ways, m_sets;
+		std::vector<uint64_t> m_lines;
+	};
+
+	Level m_l1, m_l2;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef logic_sim_event_hpp
+#define logic_sim_event_hpp
+
+#include <algorithm>
+#include <vector>
+
+#include "logic_sim_netlist.hpp"
+
+/* Activity based simulation of a LogicSimNetlist.
+
+   The flip-flops that changed at the last clock edge are tracked, and only
+   the gates in their fanout are re-evaluated, level by level, propagating
+   further only from gates whose output actually toggled. When too large a
+   fraction of the netlist is active the engine falls back to full levelised
+   sweeps, and periodically probes with an event-driven cycle to see whether
+   activity has dropped again. */
+class LogicSimEventEngine
+{
+public:
+	// Switch to sweeps when more than this fraction of gates is evaluated
+	static constexpr double maxActivity = 0.25;
+	// Sweeps before probing with an event-driven cycle, doubled on failure
+	static const unsigned minProbeInterval = 4;
+	static const unsigned maxProbeInterval = 256;
+
+	explicit LogicSimEventEngine(const LogicSimNetlist &netlist)
+		: m_netlist(netlist)
+		, m_sweep(true)
+		, m_probing(false)
+		, m_probeInterval(minProbeInterval)
+		, m_countdown(0)
+		, m_stamp(0)
+		, m_eventCycles(0)
+		, m_sweepCycles(0)
+	{
+		unsigned ff = netlist.flipFlopCount;
+		unsigned gates = netlist.gateCount();
+		unsigned values = netlist.valueCount();
+
+		m_gateLevel.resize(gates);
+		for (unsigned l = 0; l != netlist.levelCount(); l++)
+			std::fill(m_gateLevel.begin() + netlist.levels[l],
+					m_gateLevel.begin() + netlist.levels[l + 1], l);
+		m_buckets.resize(netlist.levelCount());
+
+		// Fanout lists, in compressed sparse row form
+		m_gateFanoutOffset.assign(values + 1, 0);
+		for (unsigned g = 0; g != gates; g++) {
+			m_gateFanoutOffset[netlist.gateSrc1[g] + 1]++;
+			if (netlist.gateSrc2[g] != netlist.gateSrc1[g])
+				m_gateFanoutOffset[netlist.gateSrc2[g] + 1]++;
+		}
+		for (unsigned v = 0; v != values; v++)
+			m_gateFanoutOffset[v + 1] += m_gateFanoutOffset[v];
+		m_gateFanout.resize(m_gateFanoutOffset[values]);
+		{
+			std::vector<uint32_t> fill(m_gateFanoutOffset.begin(), m_gateFanoutOffset.end() - 1);
+			for (unsigned g = 0; g != gates; g++) {
+				m_gateFanout[fill[netlist.gateSrc1[g]]++] = g;
+				if (netlist.gateSrc2[g] != netlist.gateSrc1[g])
+					m_gateFanout[fill[netlist.gateSrc2[g]]++] = g;
+			}
+		}
+
+		m_ffFanoutOffset.assign(values + 1, 0);
+		for (unsigned i = 0; i != ff; i++)
+			m_ffFanoutOffset[netlist.flipFlopSrc[i] + 1]++;
+		for (unsigned v = 0; v != values; v++)
+			m_ffFanoutOffset[v + 1] += m_ffFanoutOffset[v];
+		m_ffFanout.resize(ff);
+		{
+			std::vector<uint32_t> fill(m_ffFanoutOffset.begin(), m_ffFanoutOffset.end() - 1);
+			for (unsigned i = 0; i != ff; i++)
+				m_ffFanout[fill[netlist.flipFlopSrc[i]]++] = i;
+		}
+
+		m_gateStamp.assign(gates, 0);
+		m_next.resize(ff);
+		m_prev.resize(ff);
+	}
+
+	unsigned eventCycles() const
+	{ return m_eventCycles; }
+
+	unsigned sweepCycles() const
+	{ return m_sweepCycles; }
+
+	// One clock cycle. Gate values must be left untouched between calls
+	void step(uint8_t *values)
+	{
+		if (m_sweep) {
+			if (m_countdown != 0 || m_sweepCycles == 0) {
+				if (m_countdown)
+					m_countdown--;
+				// Only the sweep just before a probe needs to track changes
+				sweep(values, m_countdown == 0);
+				return;
+			}
+			m_sweep = false;
+			m_probing = true;
+		}
+
+		double activity = event(values);
+		if (activity > maxActivity) {
+			// Back off further each time a probe finds the netlist still busy
+			if (m_probing)
+				m_probeInterval = std::min(unsigned(maxProbeInterval), m_probeInterval * 2);
+			else
+				m_probeInterval = minProbeInterval;
+			m_sweep = true;
+			m_countdown = m_probeInterval;
+		}
+		m_probing = false;
+	}
+
+private:
+	const LogicSimNetlist &m_netlist;
+
+	std::vector<uint32_t> m_gateLevel;
+	std::vector<uint32_t> m_gateFanoutOffset, m_gateFanout;
+	std::vector<uint32_t> m_ffFanoutOffset, m_ffFanout;
+
+	bool m_sweep, m_probing;
+	unsigned m_probeInterval, m_countdown;
+
+	// Flip-flops which changed at the last clock edge
+	std::vector<uint32_t> m_changed;
+	// Values which changed during the current cycle
+	std::vector<uint32_t> m_toggled;
+	std::vector<std::vector<uint32_t> > m_buckets;
+	std::vector<uint32_t> m_gateStamp;
+	uint32_t m_stamp;
+
+	std::vector<uint8_t> m_next, m_prev;
+
+	unsigned m_eventCycles, m_sweepCycles;
+
+	void sweep(uint8_t *values, bool track, unsigned firstLevel = 0)
+	{
+		unsigned ff = m_netlist.flipFlopCount;
+		if (!track) {
+			m_netlist.eval(values, firstLevel);
+			m_netlist.latch(values, m_next.data());
+			m_sweepCycles++;
+			return;
+		}
+
+		std::copy(values, values + ff, m_prev.begin());
+		m_netlist.eval(values, firstLevel);
+		m_netlist.latch(values, m_next.data());
+
+		// Branch-free compaction, as about half the flip-flops toggle in busy netlists
+		m_changed.resize(ff);
+		unsigned count = 0;
+		for (unsigned i = 0; i != ff; i++) {
+			m_changed[count] = i;
+			count += values[i] != m_prev[i];
+		}
+		m_changed.resize(count);
+		m_sweepCycles++;
+	}
+
+	void schedule(uint32_t value)
+	{
+		for (uint32_t j = m_gateFanoutOffset[value]; j != m_gateFanoutOffset[value + 1]; j++) {
+			uint32_t g = m_gateFanout[j];
+			if (m_gateStamp[g] != m_stamp) {
+				m_gateStamp[g] = m_stamp;
+				m_buckets[m_gateLevel[g]].push_back(g);
+			}
+		}
+	}
+
+	// Returns the fraction of gates that had to be evaluated
+	double event(uint8_t *values)
+	{
+		unsigned ff = m_netlist.flipFlopCount;
+		const uint32_t *s1 = m_netlist.gateSrc1.data(), *s2 = m_netlist.gateSrc2.data();
+		uint8_t *out = values + ff;
+
+		if (++m_stamp == 0) {
+			std::fill(m_gateStamp.begin(), m_gateStamp.end(), 0);
+			m_stamp = 1;
+		}
+
+		m_toggled.assign(m_changed.begin(), m_changed.end());
+		for (uint32_t i: m_changed)
+			schedule(i);
+
+		unsigned evaluated = 0;
+		unsigned limit = unsigned(maxActivity * m_netlist.gateCount());
+		for (unsigned l = 0; l != m_buckets.size(); l++) {
+			std::vector<uint32_t> &bucket = m_buckets[l];
+			evaluated += bucket.size();
+			if (evaluated > limit) {
+				// Too busy: the levels so far are exact, so finish with a sweep
+				for (unsigned k = l; k != m_buckets.size(); k++)
+					m_buckets[k].clear();
+				sweep(values, true, l);
+				return 1.0;
+			}
+			for (uint32_t g: bucket) {
+				uint8_t v = values[s1[g]] ^ values[s2[g]];
+				if (v != out[g]) {
+					out[g] = v;
+					m_toggled.push_back(ff + g);
+					schedule(ff + g);
+				}
+			}
+			bucket.clear();
+		}
+
+		// Clock edge: only flip-flops fed by a toggled value can change
+		m_changed.clear();
+		for (uint32_t v: m_toggled)
+			for (uint32_t j = m_ffFanoutOffset[v]; j != m_ffFanoutOffset[v + 1]; j++)
+				m_changed.push_back(m_ffFanout[j]);
+		for (uint32_t i: m_changed)
+			m_next[i] = values[m_netlist.flipFlopSrc[i]];
+		for (uint32_t i: m_changed)
+			values[i] = m_next[i];
+
+		m_eventCycles++;
+		return m_netlist.gateCount() ? double(evaluated) / m_netlist.gateCount() : 0.0;
+	}
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef logic_sim_netlist_hpp
+#define logic_sim_netlist_hpp
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "puzzler/puzzles/logic_sim.hpp"
+
+/* Levelised form of a LogicSimInput.
+
+   Values are numbered with the flip-flops first, followed by the xor gates
+   sorted by level, so a gate only ever reads values with a smaller index and
+   all the gates within one level can be evaluated concurrently. Inside a
+   level the gates are ordered by their (renumbered) sources, which puts gates
+   sharing an input next to each other in memory. */
+class LogicSimNetlist
+{
+public:
+	// Levels narrower than this are evaluated serially
+	static const unsigned parallelWidth = 4096;
+	// Smallest chunk of gates handed to one task
+	static const unsigned minGrain = 1024;
+
+	unsigned flipFlopCount;
+	// Sources of each gate, in value space
+	std::vector<uint32_t> gateSrc1, gateSrc2;
+	// Gate offsets of each level, with a trailing end marker
+	std::vector<uint32_t> levels;
+	// Value index of the next state of each flip-flop
+	std::vector<uint32_t> flipFlopSrc;
+	// Index in the original input of each flip-flop, for reordered netlists
+	std::vector<uint32_t> flipFlopOrigin;
+
+	LogicSimNetlist()
+		: flipFlopCount(0)
+		, m_threads(std::max(1u, std::thread::hardware_concurrency()))
+	{}
+
+	explicit LogicSimNetlist(const puzzler::LogicSimInput *input)
+		: LogicSimNetlist()
+	{
+		compile(input->flipFlopInputs.size(), input->xorGateInputs, input->flipFlopInputs);
+	}
+
+	unsigned gateCount() const
+	{ return gateSrc1.size(); }
+
+	unsigned levelCount() const
+	{ return levels.size() - 1; }
+
+	unsigned valueCount() const
+	{ return flipFlopCount + gateCount(); }
+
+	void compile(unsigned ffCount,
+			const std::vector<std::pair<int32_t, int32_t> > &xorGateInputs,
+			const std::vector<int32_t> &flipFlopInputs)
+	{
+		flipFlopCount = ffCount;
+		unsigned gates = xorGateInputs.size();
+		unsigned values = ffCount + gates;
+
+		// Level of every original gate; flip-flops are level 0
+		const uint32_t pending = ~0u;
+		std::vector<uint32_t> level(gates, 0);
+		auto levelOf = [&](uint32_t src) -> uint32_t {
+			if (src >= values)
+				throw std::runtime_error("LogicSimNetlist::compile - source out of range.");
+			return src < ffCount ? 0 : level[src - ffCount];
+		};
+
+		// Iterative depth-first walk, as gate chains can be very deep
+		std::vector<uint32_t> stack;
+		for (unsigned g = 0; g != gates; g++) {
+			if (level[g])
+				continue;
+			stack.push_back(g);
+			level[g] = pending;
+			while (!stack.empty()) {
+				uint32_t t = stack.back();
+				uint32_t s1 = xorGateInputs[t].first, s2 = xorGateInputs[t].second;
+				uint32_t l1 = levelOf(s1), l2 = levelOf(s2);
+				if (l1 == 0 && s1 >= ffCount) {
+					level[s1 - ffCount] = pending;
+					stack.push_back(s1 - ffCount);
+					continue;
+				}
+				if (l2 == 0 && s2 >= ffCount) {
+					level[s2 - ffCount] = pending;
+					stack.push_back(s2 - ffCount);
+					continue;
+				}
+				if (l1 == pending || l2 == pending)
+					throw std::runtime_error("LogicSimNetlist::compile - combinational loop.");
+				level[t] = 1 + std::max(l1, l2);
+				stack.pop_back();
+			}
+		}
+
+		// Bucket the gates by level
+		unsigned depth = 0;
+		for (uint32_t l: level)
+			depth = std::max(depth, (unsigned)l);
+		levels.assign(depth + 1, 0);
+		for (uint32_t l: level)
+			levels[l - 1]++;
+		for (unsigned l = 0, sum = 0; l != levels.size(); l++) {
+			unsigned n = levels[l];
+			levels[l] = sum;
+			sum += n;
+		}
+		std::vector<uint32_t> order(gates);
+		{
+			std::vector<uint32_t> fill(levels.begin(), levels.end() - 1);
+			for (unsigned g = 0; g != gates; g++)
+				order[fill[level[g] - 1]++] = g;
+		}
+
+		// Renumber level by level, sorting each level by its renumbered sources
+		std::vector<uint32_t> remap(values);
+		for (unsigned i = 0; i != ffCount; i++)
+			remap[i] = i;
+		gateSrc1.resize(gates);
+		gateSrc2.resize(gates);
+		for (unsigned l = 0; l + 1 < levels.size(); l++) {
+			uint32_t begin = levels[l], end = levels[l + 1];
+			for (uint32_t i = begin; i != end; i++) {
+				uint32_t a = remap[xorGateInputs[order[i]].first];
+				uint32_t b = remap[xorGateInputs[order[i]].second];
+				gateSrc1[i] = std::min(a, b);
+				gateSrc2[i] = std::max(a, b);
+			}
+			std::vector<uint32_t> idx(end - begin);
+			for (uint32_t i = 0; i != idx.size(); i++)
+				idx[i] = begin + i;
+			std::sort(idx.begin(), idx.end(), [&](uint32_t x, uint32_t y) {
+				return gateSrc1[x] != gateSrc1[y] ? gateSrc1[x] < gateSrc1[y] : gateSrc2[x] < gateSrc2[y];
+			});
+			std::vector<uint32_t> src1(idx.size()), src2(idx.size()), orig(idx.size());
+			for (uint32_t i = 0; i != idx.size(); i++) {
+				src1[i] = gateSrc1[idx[i]];
+				src2[i] = gateSrc2[idx[i]];
+				orig[i] = order[idx[i]];
+			}
+			for (uint32_t i = 0; i != idx.size(); i++) {
+				gateSrc1[begin + i] = src1[i];
+				gateSrc2[begin + i] = src2[i];
+				order[begin + i] = orig[i];
+				remap[ffCount + orig[i]] = ffCount + begin + i;
+			}
+		}
+
+		flipFlopSrc.resize(flipFlopInputs.size());
+		for (unsigned i = 0; i != flipFlopInputs.size(); i++) {
+			if ((uint32_t)flipFlopInputs[i] >= values)
+				throw std::runtime_error("LogicSimNetlist::compile - flip-flop source out of range.");
+			flipFlopSrc[i] = remap[flipFlopInputs[i]];
+		}
+		flipFlopOrigin.resize(ffCount);
+		for (unsigned i = 0; i != ffCount; i++)
+			flipFlopOrigin[i] = i;
+	}
+
+	// Evaluate every gate from the flip-flop values in values[0..flipFlopCount),
+	// or only the levels from firstLevel onwards if the earlier ones are known
+	template<class T>
+	void eval(T *values, unsigned firstLevel = 0) const
+	{
+		for (unsigned l = firstLevel; l < levelCount(); l++) {
+			unsigned begin = levels[l], end = levels[l + 1];
+			unsigned width = end - begin;
+			if (width < parallelWidth) {
+				evalRange(values, begin, end);
+				continue;
+			}
+			unsigned grain = std::max(unsigned(minGrain), width / (m_threads * 8));
+			tbb::parallel_for(tbb::blocked_range<unsigned>(begin, end, grain),
+					[=](const tbb::blocked_range<unsigned> &r) {
+				evalRange(values, r.begin(), r.end());
+			});
+		}
+	}
+
+	// Clock the flip-flops, reading the evaluated values
+	template<class T>
+	void latch(T *values, T *next) const
+	{
+		unsigned n = flipFlopCount;
+		if (n < parallelWidth) {
+			for (unsigned i = 0; i != n; i++)
+				next[i] = values[flipFlopSrc[i]];
+		} else {
+			tbb::parallel_for(tbb::blocked_range<unsigned>(0, n, minGrain),
+					[=](const tbb::blocked_range<unsigned> &r) {
+				for (unsigned i = r.begin(); i != r.end(); i++)
+					next[i] = values[flipFlopSrc[i]];
+			});
+		}
+		std::copy(next, next + n, values);
+	}
+
+	// One clock cycle
+	template<class T>
+	void step(T *values, T *next) const
+	{
+		eval(values);
+		latch(values, next);
+	}
+
+private:
+	unsigned m_threads;
+
+	template<class T>
+	void evalRange(T *values, unsigned begin, unsigned end) const
+	{
+		T *out = values + flipFlopCount;
+		const uint32_t *s1 = gateSrc1.data(), *s2 = gateSrc2.data();
+		for (unsigned g = begin; g != end; g++)
+			out[g] = T(values[s1[g]] ^ values[s2[g]]);
+	}
+};
+
+/* Bit-sliced machine words: each bit of a word carries the value of one
+   independent stimulus, so an xor of two words evaluates a gate for all of
+   them at once. */
+template<class W>
+struct LogicSimLanes;
+
+template<>
+struct LogicSimLanes<uint64_t>
+{
+	static const unsigned count = 64;
+
+	static void set(uint64_t &w, unsigned k)
+	{ w |= uint64_t(1) << k; }
+
+	static bool get(const uint64_t &w, unsigned k)
+	{ return (w >> k) & 1; }
+};
+
+#ifdef __AVX2__
+typedef uint64_t logic_sim_u64x4_t __attribute__((vector_size(32)));
+
+template<>
+struct LogicSimLanes<logic_sim_u64x4_t>
+{
+	static const unsigned count = 256;
+
+	static void set(logic_sim_u64x4_t &w, unsigned k)
+	{ w[k / 64] |= uint64_t(1) << (k % 64); }
+
+	static bool get(const logic_sim_u64x4_t &w, unsigned k)
+	{ return (w[k / 64] >> (k % 64)) & 1; }
+};
+
+typedef logic_sim_u64x4_t logic_sim_lane_t;
+#else
+typedef uint64_t logic_sim_lane_t;
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef logic_sim_optimise_hpp
+#define logic_sim_optimise_hpp
+
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "puzzler/puzzles/logic_sim.hpp"
+
+/* Simplifies the netlist of a LogicSimInput before it is compiled.
+
+   Gates are rebuilt on demand from the flip-flop inputs, so anything outside
+   a flip-flop cone is never created. While rebuilding, a^a folds to zero,
+   x^0 folds to x, and gates with the same pair of (already simplified)
+   sources are hash-consed into one. A final liveness pass removes gates that
+   lost all their readers through folding. The result uses the same encoding
+   as LogicSimInput, with the gates in topological order; if some flip-flop
+   is driven by a constant zero, one extra gate "ff0 ^ ff0" provides it. */
+class LogicSimOptimiser
+{
+public:
+	std::vector<std::pair<int32_t, int32_t> > xorGateInputs;
+	std::vector<int32_t> flipFlopInputs;
+
+	unsigned gatesBefore, gatesAfter;
+	// Gates outside every flip-flop cone
+	unsigned deadGates;
+	// Gates folded into a constant or into one of their sources
+	unsigned foldedGates;
+	// Gates merged into an identical gate
+	unsigned sharedGates;
+
+	LogicSimOptimiser()
+		: gatesBefore(0), gatesAfter(0)
+		, deadGates(0), foldedGates(0), sharedGates(0)
+	{}
+
+	explicit LogicSimOptimiser(const puzzler::LogicSimInput *input)
+		: LogicSimOptimiser()
+	{
+		optimise(input->flipFlopInputs.size(), input->xorGateInputs, input->flipFlopInputs);
+	}
+
+	void optimise(unsigned ffCount,
+			const std::vector<std::pair<int32_t, int32_t> > &gates,
+			const std::vector<int32_t> &ffInputs)
+	{
+		const uint32_t zero = ~0u, unvisited = ~1u, pending = ~2u;
+		unsigned values = ffCount + gates.size();
+		gatesBefore = gates.size();
+		deadGates = foldedGates = sharedGates = 0;
+
+		// Simplified gates, numbered after the flip-flops in creation order
+		std::vector<std::pair<uint32_t, uint32_t> > built;
+		std::unordered_map<uint64_t, uint32_t> unique;
+		unique.reserve(gates.size());
+
+		// What each original gate became: a value in the new numbering or zero
+		std::vector<uint32_t> canon(gates.size(), unvisited);
+		auto canonOf = [&](uint32_t src) -> uint32_t {
+			if (src >= values)
+				throw std::runtime_error("LogicSimOptimiser::optimise - source out of range.");
+			return src < ffCount ? src : canon[src - ffCount];
+		};
+		auto unresolved = [&](uint32_t c) {
+			return c == unvisited || c == pending;
+		};
+
+		std::vector<uint32_t> stack;
+		unsigned visited = 0;
+		for (int32_t root: ffInputs) {
+			if ((uint32_t)root < ffCount || !unresolved(canonOf(root)))
+				continue;
+			stack.push_back(root - ffCount);
+			canon[root - ffCount] = pending;
+			while (!stack.empty()) {
+				uint32_t t = stack.back();
+				uint32_t s1 = gates[t].first, s2 = gates[t].second;
+				uint32_t a = canonOf(s1), b = canonOf(s2);
+				if (a == unvisited) {
+					canon[s1 - ffCount] = pending;
+					stack.push_back(s1 - ffCount);
+					continue;
+				}
+				if (b == unvisited) {
+					canon[s2 - ffCount] = pending;
+					stack.push_back(s2 - ffCount);
+					continue;
+				}
+				if (a == pending || b == pending)
+					throw std::runtime_error("LogicSimOptimiser::optimise - combinational loop.");
+				stack.pop_back();
+				visited++;
+
+				if (a == b) {
+					canon[t] = zero;
+					foldedGates++;
+				} else if (a == zero || b == zero) {
+					canon[t] = a == zero ? b : a;
+					foldedGates++;
+				} else {
+					uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+					auto it = unique.find(key);
+					if (it != unique.end()) {
+						canon[t] = it->second;
+						sharedGates++;
+					} else {
+						canon[t] = ffCount + built.size();
+						built.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+						unique.insert(std::make_pair(key, canon[t]));
+					}
+				}
+			}
+		}
+		deadGates = gates.size() - visited;
+
+		// Folding can leave built gates without readers, so sweep them out
+		std::vector<uint32_t> roots(ffInputs.size());
+		std::vector<bool> live(ffCount + built.size(), false);
+		bool needZero = false;
+		for (unsigned i = 0; i != ffInputs.size(); i++) {
+			roots[i] = canonOf(ffInputs[i]);
+			if (roots[i] == zero)
+				needZero = true;
+			else
+				live[roots[i]] = true;
+		}
+		for (unsigned g = built.size(); g-- != 0; ) {
+			if (live[ffCount + g]) {
+				live[built[g].first] = true;
+				live[built[g].second] = true;
+			}
+		}
+
+		std::vector<uint32_t> remap(ffCount + built.size());
+		for (unsigned i = 0; i != ffCount; i++)
+			remap[i] = i;
+		xorGateInputs.clear();
+		for (unsigned g = 0; g != built.size(); g++) {
+			if (!live[ffCount + g])
+				continue;
+			remap[ffCount + g] = ffCount + xorGateInputs.size();
+			xorGateInputs.push_back(std::make_pair(
+					int32_t(remap[built[g].first]), int32_t(remap[built[g].second])));
+		}
+		foldedGates += built.size() - xorGateInputs.size();
+
+		uint32_t zeroGate = ffCount + xorGateInputs.size();
+		if (needZero)
+			xorGateInputs.push_back(std::make_pair(0, 0));
+
+		flipFlopInputs.resize(ffInputs.size());
+		for (unsigned i = 0; i != ffInputs.size(); i++)
+			flipFlopInputs[i] = roots[i] == zero ? zeroGate : remap[roots[i]];
+
+		gatesAfter = xorGateInputs.size();
+	}
+};
+
+#endif
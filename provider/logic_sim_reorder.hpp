@@ -0,0 +1,107 @@
+#ifndef logic_sim_reorder_hpp
+#define logic_sim_reorder_hpp
+
+#include <stdexcept>
+#include <vector>
+
+/* Renumbers flip-flops and gates so that values used together sit together.
+
+   Flip-flops are visited breadth first through the flip-flop to flip-flop
+   dependencies: the cone feeding each one is walked depth first, the
+   flip-flops at its leaves are numbered in the order they are reached, and
+   their own cones are walked later in that same order. Gates are numbered in
+   post-order of the walk, so every gate comes right after the gates it reads
+   and a whole cone occupies one contiguous range. The result uses the same
+   encoding as LogicSimInput; flipFlopOrigin maps each new flip-flop index
+   back to the original one. */
+class LogicSimReorder
+{
+public:
+	std::vector<std::pair<int32_t, int32_t> > xorGateInputs;
+	std::vector<int32_t> flipFlopInputs;
+	// Original index of each renumbered flip-flop
+	std::vector<uint32_t> flipFlopOrigin;
+
+	LogicSimReorder()
+	{}
+
+	LogicSimReorder(unsigned ffCount,
+			const std::vector<std::pair<int32_t, int32_t> > &gates,
+			const std::vector<int32_t> &ffInputs)
+	{
+		reorder(ffCount, gates, ffInputs);
+	}
+
+	void reorder(unsigned ffCount,
+			const std::vector<std::pair<int32_t, int32_t> > &gates,
+			const std::vector<int32_t> &ffInputs)
+	{
+		const uint32_t unvisited = ~0u, pending = ~1u;
+		unsigned values = ffCount + gates.size();
+		if (ffInputs.size() != ffCount)
+			throw std::runtime_error("LogicSimReorder::reorder - flip-flop count is inconsistent.");
+
+		// New index of every original value
+		std::vector<uint32_t> remap(values, unvisited);
+		flipFlopOrigin.clear();
+		flipFlopOrigin.reserve(ffCount);
+		xorGateInputs.clear();
+		xorGateInputs.reserve(gates.size());
+		auto visit = [&](uint32_t src) -> uint32_t {
+			if (src >= values)
+				throw std::runtime_error("LogicSimReorder::reorder - source out of range.");
+			if (src < ffCount && remap[src] == unvisited) {
+				remap[src] = flipFlopOrigin.size();
+				flipFlopOrigin.push_back(src);
+			}
+			return remap[src];
+		};
+
+		std::vector<uint32_t> stack;
+		auto walk = [&](uint32_t root) {
+			if (visit(root) != unvisited)
+				return;
+			remap[root] = pending;
+			stack.push_back(root);
+			while (!stack.empty()) {
+				uint32_t v = stack.back();
+				uint32_t s1 = gates[v - ffCount].first, s2 = gates[v - ffCount].second;
+				uint32_t a = visit(s1), b = visit(s2);
+				if (a == unvisited) {
+					remap[s1] = pending;
+					stack.push_back(s1);
+					continue;
+				}
+				if (b == unvisited) {
+					remap[s2] = pending;
+					stack.push_back(s2);
+					continue;
+				}
+				if (a == pending || b == pending)
+					throw std::runtime_error("LogicSimReorder::reorder - combinational loop.");
+				stack.pop_back();
+				remap[v] = ffCount + xorGateInputs.size();
+				xorGateInputs.push_back(std::make_pair(int32_t(a), int32_t(b)));
+			}
+		};
+
+		// The numbering of the flip-flops doubles as the breadth-first queue
+		for (unsigned next = 0, scan = 0; next != ffCount; next++) {
+			if (next == flipFlopOrigin.size()) {
+				while (remap[scan] != unvisited)
+					scan++;
+				visit(scan);
+			}
+			walk(ffInputs[flipFlopOrigin[next]]);
+		}
+		// Gates outside every cone keep their relative order at the end
+		for (uint32_t v = ffCount; v != values; v++)
+			walk(v);
+
+		flipFlopInputs.resize(ffCount);
+		for (unsigned i = 0; i != ffCount; i++)
+			flipFlopInputs[i] = remap[ffInputs[flipFlopOrigin[i]]];
+	}
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef radix_sort_hpp
+#define radix_sort_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+/* Parallel least significant digit radix sort of 64-bit keys into descending
+   order, looking only at the low bits of each key.
+
+   Every pass splits the keys into blocks, counts the digits of each block in
+   parallel, turns the counts into per-block output offsets, then scatters the
+   blocks in parallel. Digits are inverted while counting, so the stable
+   ascending sort this gives is a descending sort of the keys. */
+inline void radixSortDescending(std::vector<uint64_t> &keys, unsigned bits)
+{
+	const unsigned digitBits = 8, radix = 1u << digitBits;
+	// Fewest keys worth handing to one task
+	const size_t minBlock = 16384;
+
+	size_t n = keys.size();
+	if (n < 2)
+		return;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned blocks = unsigned(std::max<size_t>(1, std::min<size_t>(n / minBlock, threads * 4)));
+	size_t blockSize = (n + blocks - 1) / blocks;
+
+	std::vector<uint64_t> buffer(n);
+	uint64_t *src = keys.data(), *dst = buffer.data();
+	std::vector<size_t> offsets(size_t(blocks) * radix);
+
+	for (unsigned shift = 0; shift < bits; shift += digitBits) {
+		auto digit = [=](uint64_t key) {
+			return radix - 1 - unsigned((key >> shift) & (radix - 1));
+		};
+
+		tbb::parallel_for(0u, blocks, [&](unsigned b) {
+			size_t *count = &offsets[size_t(b) * radix];
+			std::fill(count, count + radix, 0);
+			for (size_t i = b * blockSize, end = std::min(n, i + blockSize); i < end; i++)
+				count[digit(src[i])]++;
+		});
+
+		// Exclusive scan, digit major so each block scatters after earlier blocks
+		size_t sum = 0;
+		bool trivial = false;
+		for (unsigned d = 0; d != radix; d++) {
+			size_t start = sum;
+			for (unsigned b = 0; b != blocks; b++) {
+				size_t c = offsets[size_t(b) * radix + d];
+				offsets[size_t(b) * radix + d] = sum;
+				sum += c;
+			}
+			trivial = trivial || sum - start == n;
+		}
+		// Every key has the same digit here, so this pass would not move anything
+		if (trivial)
+			continue;
+
+		tbb::parallel_for(0u, blocks, [&](unsigned b) {
+			size_t *offset = &offsets[size_t(b) * radix];
+			for (size_t i = b * blockSize, end = std::min(n, i + blockSize); i < end; i++)
+				dst[offset[digit(src[i])]++] = src[i];
+		});
+		std::swap(src, dst);
+	}
+
+	if (src != keys.data())
+		keys.swap(buffer);
+}
+
+/* Sort (count, id) pairs into the same order as
+   std::sort(histogram.rbegin(), histogram.rend()), by packing each pair into
+   a key just wide enough for the largest count and id. */
+inline void sortHistogramDescending(std::vector<std::pair<uint32_t, uint32_t> > &histogram)
+{
+	// Small inputs are not worth the passes
+	if (histogram.size() < 4096) {
+		std::sort(histogram.rbegin(), histogram.rend());
+		return;
+	}
+
+	uint32_t maxCount = 0, maxId = 0;
+	for (const auto &p: histogram) {
+		maxCount = std::max(maxCount, p.first);
+		maxId = std::max(maxId, p.second);
+	}
+	auto width = [](uint32_t x) {
+		unsigned bits = 0;
+		while (bits < 32 && (x >> bits))
+			bits++;
+		return bits;
+	};
+	unsigned idBits = width(maxId);
+	uint64_t idMask = (uint64_t(1) << idBits) - 1;
+
+	std::vector<uint64_t> keys(histogram.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, keys.size()),
+			[&](const tbb::blocked_range<size_t> &r) {
+		for (size_t i = r.begin(); i != r.end(); i++)
+			keys[i] = (uint64_t(histogram[i].first) << idBits) | histogram[i].second;
+	});
+
+	radixSortDescending(keys, idBits + width(maxCount));
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, keys.size()),
+			[&](const tbb::blocked_range<size_t> &r) {
+		for (size_t i = r.begin(); i != r.end(); i++)
+			histogram[i] = std::make_pair(uint32_t(keys[i] >> idBits), uint32_t(keys[i] & idMask));
+	});
+}
+
+#endif
@@ -1,40 +1,67 @@
-/* Start from node start, then follow a random walk of length nodes, incrementing
-   the count of all the nodes we visit. */
-__kernel void random_walk(__global const unsigned *edges, __global uint *count, \
-	__global const uint *seed, __global const unsigned *start, \
-	unsigned len, unsigned nodesCount, unsigned edgesCount, unsigned offset)
-{
-	uint i = get_global_id(0);
-	count += i * nodesCount;
-	i += offset;
-	uint rng = *(seed + i);
-	unsigned current = *(start + i);
-	
-	// Initialise output buffer
-	__global uint *ptr = count;
-	uint s = nodesCount;
-	while (s--)
-		*ptr++ = 0;
+/* Edge selection, chosen on the host through build options:
+   RW_DEGREE and RW_DEGREE_MASK for a power of two degree shared by every node,
+   RW_DEGREE and RW_DEGREE_M for any other shared degree (Lemire's fastmod),
+   RW_PICK_DIVIDE for the plain remainder, and otherwise a fastmod multiplier
+   per node. Each gives exactly rng % degree. */
+#if defined(RW_DEGREE_MASK)
+#define PICK(node, rng)	((node) * RW_DEGREE + ((rng) & RW_DEGREE_MASK))
+#elif defined(RW_DEGREE)
+#define PICK(node, rng)	((node) * RW_DEGREE + (uint)mul_hi((ulong)RW_DEGREE_M * (rng), (ulong)RW_DEGREE))
+#elif defined(RW_PICK_DIVIDE)
+#define PICK(node, rng)	(offsets[node] + (rng) % (offsets[(node) + 1] - offsets[node]))
+#else
+#define PICK(node, rng)	(offsets[node] + (uint)mul_hi(multipliers[node] * (rng), \
+		(ulong)(offsets[(node) + 1] - offsets[node])))
+#endif
 
-	while (len--) {
-		//nodes[current].count++;
-		count[current]++;
-		current = edges[current * edgesCount + rng % edgesCount];
-		rng = rng * 1664525 + 1013904223;
+/* Walk samples i, i + workers, i + 2 * workers, ... from their start nodes,
+   counting every node visited with INC. */
+#define WALK(INC) \
+	for (; i < samples; i += workers) { \
+		uint rng = seed[i]; \
+		unsigned current = start[i]; \
+		for (uint l = len; l--; ) { \
+			INC; \
+			current = edges[PICK(current, rng)]; \
+			rng = rng * 1664525 + 1013904223; \
+		} \
 	}
+
+// Zero the histogram, as OpenCL 1.1 has no clEnqueueFillBuffer
+__kernel void random_walk_clear(__global uint *count)
+{
+	count[get_global_id(0)] = 0;
 }
 
-// Summarise count buffers
-__kernel void random_walk_comb(uint blocks, __global const uint *in, uint offset, __global uint *out)
+// Every work-item counts straight into the one global histogram
+__kernel void random_walk(__global const uint *offsets, __global const ulong *multipliers, \
+	__global const uint *edges, __global uint *count, __global const uint *seed, \
+	__global const unsigned *start, unsigned len, unsigned nodesCount, unsigned samples)
 {
 	uint i = get_global_id(0);
-	uint nodesCount = get_global_size(0);
-	in += i;
-	out += offset * nodesCount + i;
-	uint count = 0;
-	while (blocks--) {
-		count += *in;
-		in += nodesCount;
-	}
-	*out = count;
+	uint workers = get_global_size(0);
+	WALK(atomic_inc(&count[current]));
+}
+
+/* Each work-group counts into a histogram in local memory, then adds the
+   nonzero entries to the global histogram; for graphs that fit. */
+__kernel void random_walk_local(__global const uint *offsets, __global const ulong *multipliers, \
+	__global const uint *edges, __global uint *count, __global const uint *seed, \
+	__global const unsigned *start, unsigned len, unsigned nodesCount, unsigned samples, \
+	__local uint *localCount)
+{
+	uint i = get_global_id(0);
+	uint workers = get_global_size(0);
+	uint lid = get_local_id(0), lsize = get_local_size(0);
+
+	for (uint v = lid; v < nodesCount; v += lsize)
+		localCount[v] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	WALK(atomic_inc(&localCount[current]));
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint v = lid; v < nodesCount; v += lsize)
+		if (localCount[v])
+			atomic_add(&count[v], localCount[v]);
 }
@@ -0,0 +1,99 @@
+#ifndef random_walk_edges_hpp
+#define random_walk_edges_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+/* Edge arrays for the walkers: edges[p] is the target of the edge at position
+   p of the CSR edge array, and prefetch(p) starts loading it. */
+
+// The plain uint32_t array
+struct RandomWalkEdges
+{
+	const uint32_t *data;
+
+	uint32_t operator[](uint32_t p) const
+	{ return data[p]; }
+
+	void prefetch(uint32_t p) const
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(&data[p]);
+#else
+		(void)p;
+#endif
+	}
+};
+
+/* The same array with every target packed into just enough bits for the node
+   count, least significant bit first, so a graph of a million nodes takes 20
+   bits an edge instead of 32. A target never spans more than 5 bytes, so one
+   unaligned 64-bit load, a shift and a mask decode it. */
+class RandomWalkPackedEdges
+{
+public:
+	RandomWalkPackedEdges(const uint32_t *edges, size_t n, unsigned nodes)
+		: m_width(1)
+	{
+		while (m_width < 32 && (uint64_t(1) << m_width) < nodes)
+			m_width++;
+		m_mask = (uint64_t(1) << m_width) - 1;
+
+		// One spare word, so the load of the last target stays inside
+		m_words.assign((uint64_t(n) * m_width + 63) / 64 + 1, 0);
+		// Every run of 64 targets starts on a word boundary, so runs pack in parallel
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, (n + 63) / 64, 256),
+				[&](const tbb::blocked_range<size_t> &r) {
+			for (size_t i = r.begin() * 64, end = std::min(n, r.end() * 64); i < end; i++) {
+				uint64_t bit = uint64_t(i) * m_width;
+				unsigned shift = bit & 63;
+				m_words[bit >> 6] |= uint64_t(edges[i]) << shift;
+				if (shift + m_width > 64)
+					m_words[(bit >> 6) + 1] |= uint64_t(edges[i]) >> (64 - shift);
+			}
+		});
+	}
+
+	unsigned width() const
+	{ return m_width; }
+
+	size_t bytes() const
+	{ return m_words.size() * sizeof(uint64_t); }
+
+	uint32_t operator[](uint32_t p) const
+	{
+		uint64_t bit = uint64_t(p) * m_width;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		uint64_t x;
+		memcpy(&x, (const uint8_t *)m_words.data() + (bit >> 3), sizeof(x));
+		return uint32_t((x >> (bit & 7)) & m_mask);
+#else
+		unsigned shift = bit & 63;
+		uint64_t x = m_words[bit >> 6] >> shift;
+		if (shift + m_width > 64)
+			x |= m_words[(bit >> 6) + 1] << (64 - shift);
+		return uint32_t(x & m_mask);
+#endif
+	}
+
+	void prefetch(uint32_t p) const
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch((const uint8_t *)m_words.data() + ((uint64_t(p) * m_width) >> 3));
+#else
+		(void)p;
+#endif
+	}
+
+private:
+	unsigned m_width;
+	uint64_t m_mask;
+	std::vector<uint64_t> m_words;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef random_walk_histogram_hpp
+#define random_walk_histogram_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+
+/* Visit counts privatised per worker thread.
+
+   Each worker increments its own counter through local(), so walks never
+   share a cache line, and merge() adds the private counts together once all
+   walks are done. Counts are exact whichever form is used. */
+
+// One full array of counters per worker, for graphs where that fits in memory
+class RandomWalkDenseHistogram
+{
+public:
+	// Total bytes of private counters allowed before switching to hashing
+	static const size_t memoryBudget = size_t(256) << 20;
+
+	struct Counter
+	{
+		std::vector<uint32_t> counts;
+
+		void operator()(uint32_t node)
+		{ counts[node]++; }
+
+		void prefetch(uint32_t node) const
+		{
+#if defined(__GNUC__)
+			__builtin_prefetch(&counts[node], 1);
+#else
+			(void)node;
+#endif
+		}
+	};
+
+	explicit RandomWalkDenseHistogram(unsigned nodes)
+		: m_nodes(nodes)
+		, m_local([nodes]() { Counter c; c.counts.assign(nodes, 0); return c; })
+	{}
+
+	static bool fits(unsigned nodes)
+	{
+		unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+		return size_t(threads) * nodes * sizeof(uint32_t) <= memoryBudget;
+	}
+
+	Counter &local()
+	{ return m_local.local(); }
+
+	unsigned workers() const
+	{ return m_local.size(); }
+
+	// Sum the private arrays, in parallel over ranges of nodes
+	std::vector<uint32_t> merge()
+	{
+		std::vector<const uint32_t *> parts;
+		for (const Counter &c: m_local)
+			parts.push_back(c.counts.data());
+		std::vector<uint32_t> total(m_nodes, 0);
+		tbb::parallel_for(tbb::blocked_range<unsigned>(0, m_nodes, 4096),
+				[&](const tbb::blocked_range<unsigned> &r) {
+			for (const uint32_t *part: parts)
+				for (unsigned i = r.begin(); i != r.end(); i++)
+					total[i] += part[i];
+		});
+		return total;
+	}
+
+private:
+	unsigned m_nodes;
+	tbb::enumerable_thread_specific<Counter> m_local;
+};
+
+/* A small open-addressed table per worker, flushed with atomic adds into one
+   shared array whenever it gets half full. Memory stays at one counter per
+   node plus a fixed table per worker, however large the graph is. */
+class RandomWalkHashedHistogram
+{
+public:
+	static const unsigned tableBits = 14;
+
+	class Counter
+	{
+	public:
+		Counter(std::atomic<uint32_t> *shared = NULL)
+			: m_shared(shared)
+			, m_keys(1u << tableBits, uint32_t(empty))
+			, m_counts(1u << tableBits, 0)
+			, m_used(0)
+		{}
+
+		void operator()(uint32_t node)
+		{
+			const unsigned mask = (1u << tableBits) - 1;
+			unsigned slot = (node * 0x9e3779b1u) >> (32 - tableBits);
+			while (m_keys[slot] != node) {
+				if (m_keys[slot] == empty) {
+					if (m_used >= (1u << (tableBits - 1))) {
+						flush();
+						slot = (node * 0x9e3779b1u) >> (32 - tableBits);
+						continue;
+					}
+					m_keys[slot] = node;
+					m_used++;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+			m_counts[slot]++;
+		}
+
+		// The table is small enough to stay in cache
+		void prefetch(uint32_t) const
+		{}
+
+		void flush()
+		{
+			for (unsigned i = 0; i != m_keys.size(); i++) {
+				if (m_keys[i] != empty) {
+					m_shared[m_keys[i]].fetch_add(m_counts[i], std::memory_order_relaxed);
+					m_keys[i] = empty;
+					m_counts[i] = 0;
+				}
+			}
+			m_used = 0;
+		}
+
+	private:
+		static const uint32_t empty = ~0u;
+
+		std::atomic<uint32_t> *m_shared;
+		std::vector<uint32_t> m_keys, m_counts;
+		unsigned m_used;
+	};
+
+	explicit RandomWalkHashedHistogram(unsigned nodes)
+		: m_shared(nodes)
+		, m_local([this]() { return Counter(m_shared.data()); })
+	{}
+
+	Counter &local()
+	{ return m_local.local(); }
+
+	unsigned workers() const
+	{ return m_local.size(); }
+
+	std::vector<uint32_t> merge()
+	{
+		for (Counter &c: m_local)
+			c.flush();
+		std::vector<uint32_t> total(m_shared.size());
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, m_shared.size(), 4096),
+				[&](const tbb::blocked_range<size_t> &r) {
+			for (size_t i = r.begin(); i != r.end(); i++)
+				total[i] = m_shared[i].load(std::memory_order_relaxed);
+		});
+		return total;
+	}
+
+private:
+	std::vector<std::atomic<uint32_t> > m_shared;
+	tbb::enumerable_thread_specific<Counter> m_local;
+};
+
+#endif
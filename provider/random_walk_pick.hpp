@@ -0,0 +1,139 @@
+#ifndef random_walk_pick_hpp
+#define random_walk_pick_hpp
+
+#include <cstdint>
+#include <vector>
+
+/* Edge selection for the walkers: the position in the CSR edge array of the
+   edge a walk at node takes for a given rng value, which the reference
+   computes as offsets[node] + rng % degree(node). The hardware divide is
+   replaced according to the degrees of the graph, chosen once per input:
+
+   - every node has the same power of two degree: a mask;
+   - every node has the same degree: Lemire's fastmod, with the multiplier
+     ~0 / degree + 1 computed once, and no offsets load as the edge lists
+     are evenly spaced;
+   - otherwise: the same with a multiplier per node, stored next to the
+     node's first edge and degree so one load fetches all three.
+
+   All of them give exactly rng % degree for every 32-bit rng. A degree of
+   zero would silently pick the next node's first edge, so they rely on
+   RandomWalkInput rejecting nodes without edges when it is loaded. */
+
+// Multiplier for fastmod by d; zero for d == 1, where every remainder is zero
+inline uint64_t randomWalkFastmodMultiplier(uint32_t d)
+{
+	return d ? ~uint64_t(0) / d + 1 : 0;
+}
+
+inline uint32_t randomWalkFastmod(uint32_t a, uint64_t m, uint32_t d)
+{
+#ifdef __SIZEOF_INT128__
+	return uint32_t(((unsigned __int128)(m * a) * d) >> 64);
+#else
+	(void)m;
+	return a % d;
+#endif
+}
+
+// The reference arithmetic, kept for comparison
+struct RandomWalkPickDivide
+{
+	const uint32_t *offsets;
+
+	uint32_t operator()(uint32_t node, uint32_t rng) const
+	{
+		uint32_t first = offsets[node];
+		return first + rng % (offsets[node + 1] - first);
+	}
+
+	void prefetch(uint32_t node) const
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(&offsets[node]);
+#else
+		(void)node;
+#endif
+	}
+};
+
+struct RandomWalkPickMask
+{
+	uint32_t degree, mask;
+
+	explicit RandomWalkPickMask(uint32_t d)
+		: degree(d), mask(d - 1)
+	{}
+
+	uint32_t operator()(uint32_t node, uint32_t rng) const
+	{ return node * degree + (rng & mask); }
+
+	void prefetch(uint32_t) const
+	{}
+};
+
+struct RandomWalkPickFixed
+{
+	uint32_t degree;
+	uint64_t multiplier;
+
+	explicit RandomWalkPickFixed(uint32_t d)
+		: degree(d), multiplier(randomWalkFastmodMultiplier(d))
+	{}
+
+	uint32_t operator()(uint32_t node, uint32_t rng) const
+	{ return node * degree + randomWalkFastmod(rng, multiplier, degree); }
+
+	void prefetch(uint32_t) const
+	{}
+};
+
+struct RandomWalkPickVariable
+{
+	struct Node
+	{
+		uint32_t first, degree;
+		uint64_t multiplier;
+	};
+
+	std::vector<Node> nodes;
+
+	explicit RandomWalkPickVariable(const std::vector<uint32_t> &offsets)
+		: nodes(offsets.size() - 1)
+	{
+		for (unsigned v = 0; v != nodes.size(); v++) {
+			nodes[v].first = offsets[v];
+			nodes[v].degree = offsets[v + 1] - offsets[v];
+			nodes[v].multiplier = randomWalkFastmodMultiplier(nodes[v].degree);
+		}
+	}
+
+	uint32_t operator()(uint32_t node, uint32_t rng) const
+	{
+		const Node &n = nodes[node];
+		return n.first + randomWalkFastmod(rng, n.multiplier, n.degree);
+	}
+
+	void prefetch(uint32_t node) const
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(&nodes[node]);
+#else
+		(void)node;
+#endif
+	}
+};
+
+// Common degree of every node, or zero if the degrees differ
+inline uint32_t randomWalkUniformDegree(const std::vector<uint32_t> &offsets)
+{
+	if (offsets.size() < 2)
+		return 0;
+	uint32_t degree = offsets[1] - offsets[0];
+	for (unsigned v = 1; v + 1 < offsets.size(); v++)
+		if (offsets[v + 1] - offsets[v] != degree)
+			return 0;
+	return degree;
+}
+
+#endif
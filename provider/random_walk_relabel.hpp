@@ -0,0 +1,227 @@
+#ifndef random_walk_relabel_hpp
+#define random_walk_relabel_hpp
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "disk_cache.hpp"
+
+// provider/makefile defines this as a hash of this file, so editing an ordering misses old entries
+#ifndef RANDOM_WALK_RELABEL_SOURCE_HASH
+#define RANDOM_WALK_RELABEL_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+/* Relabels the nodes of a CSR graph so that nodes walked together sit
+   together in memory.
+
+   "bfs" numbers nodes in breadth-first order along their edges, "rcm" uses
+   reverse Cuthill-McKee (breadth first from a low degree node, visiting
+   neighbours by increasing degree, then reversed), and "degree" sorts nodes
+   by decreasing in-degree so the most visited nodes share cache lines. The
+   edge lists keep their order, only their targets are renumbered, so a walk
+   on the relabelled graph takes exactly the same steps. The order is cached
+   on disk, keyed by a hash of the graph, the mode and
+   RANDOM_WALK_RELABEL_SOURCE_HASH. */
+class RandomWalkRelabel
+{
+public:
+	// Original id of each new id, and new id of each original id
+	std::vector<uint32_t> order, rank;
+	// The relabelled graph
+	std::vector<uint32_t> offsets, edges;
+
+	bool empty() const
+	{ return order.empty(); }
+
+	// Returns true if the order came from the disk cache
+	bool build(const std::string &mode,
+			const std::vector<uint32_t> &graphOffsets, const uint32_t *graphEdges)
+	{
+		unsigned n = graphOffsets.size() - 1;
+		uint64_t edgeCount = graphOffsets.back();
+		DiskCache cache;
+		uint64_t key = 0;
+		bool cached = false;
+		if (cache.enabled()) {
+			key = ContentHash()
+					.add(RANDOM_WALK_RELABEL_SOURCE_HASH, sizeof(RANDOM_WALK_RELABEL_SOURCE_HASH))
+					.add(mode.data(), mode.size())
+					.add(graphOffsets)
+					.addValue(edgeCount)
+					.add(graphEdges, edgeCount * sizeof(uint32_t))
+					.value();
+			cached = load(cache, key, n);
+		}
+
+		if (!cached) {
+			if (mode == "bfs")
+				bfsOrder(graphOffsets, graphEdges, false);
+			else if (mode == "rcm")
+				bfsOrder(graphOffsets, graphEdges, true);
+			else if (mode == "degree")
+				degreeOrder(graphOffsets, graphEdges);
+			else
+				throw std::runtime_error("RandomWalkRelabel::build - unknown mode '" + mode + "'.");
+			if (cache.enabled())
+				store(cache, key);
+		}
+
+		rank.resize(n);
+		for (unsigned v = 0; v != n; v++)
+			rank[order[v]] = v;
+
+		offsets.resize(n + 1);
+		offsets[0] = 0;
+		for (unsigned v = 0; v != n; v++)
+			offsets[v + 1] = offsets[v] + graphOffsets[order[v] + 1] - graphOffsets[order[v]];
+		edges.resize(edgeCount);
+		tbb::parallel_for(tbb::blocked_range<unsigned>(0, n, 1024),
+				[&](const tbb::blocked_range<unsigned> &r) {
+			for (unsigned v = r.begin(); v != r.end(); v++) {
+				uint32_t j = offsets[v];
+				for (uint32_t e = graphOffsets[order[v]]; e != graphOffsets[order[v] + 1]; e++)
+					edges[j++] = rank[graphEdges[e]];
+			}
+		});
+		return cached;
+	}
+
+	// Turn counts indexed by new id into counts indexed by original id
+	void restore(std::vector<uint32_t> &counts) const
+	{
+		std::vector<uint32_t> original(counts.size());
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, counts.size()),
+				[&](const tbb::blocked_range<size_t> &r) {
+			for (size_t v = r.begin(); v != r.end(); v++)
+				original[order[v]] = counts[v];
+		});
+		counts.swap(original);
+	}
+
+private:
+	// Layout of an entry, not of the orderings, which the key covers
+	static const uint32_t entryVersion = 1;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t nodes;
+		uint64_t key;
+	};
+
+	static const char *magic()
+	{ return "RWORDER\0"; }
+
+	bool load(const DiskCache &cache, uint64_t key, unsigned n)
+	{
+		MappedFile file;
+		if (!cache.load("random_walk_order", key, file) || file.size() != sizeof(Header) + size_t(n) * sizeof(uint32_t))
+			return false;
+		Header h;
+		memcpy(&h, file.data(), sizeof(h));
+		if (memcmp(h.magic, magic(), sizeof(h.magic)) || h.version != entryVersion || h.nodes != n || h.key != key)
+			return false;
+
+		const uint32_t *p = (const uint32_t *)(file.data() + sizeof(Header));
+		order.assign(p, p + n);
+		// Anything but a permutation means a damaged entry
+		std::vector<bool> seen(n, false);
+		for (uint32_t v: order) {
+			if (v >= n || seen[v]) {
+				order.clear();
+				return false;
+			}
+			seen[v] = true;
+		}
+		return true;
+	}
+
+	bool store(const DiskCache &cache, uint64_t key) const
+	{
+		Header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, magic(), sizeof(h.magic));
+		h.version = entryVersion;
+		h.nodes = order.size();
+		h.key = key;
+		std::vector<std::pair<const void *, size_t> > chunks;
+		chunks.push_back(std::make_pair((const void *)&h, sizeof(h)));
+		chunks.push_back(std::make_pair((const void *)order.data(), order.size() * sizeof(uint32_t)));
+		return cache.store("random_walk_order", key, chunks);
+	}
+
+	static std::vector<uint32_t> inDegrees(const std::vector<uint32_t> &graphOffsets,
+			const uint32_t *graphEdges)
+	{
+		std::vector<uint32_t> degree(graphOffsets.size() - 1, 0);
+		for (uint32_t e = 0; e != graphOffsets.back(); e++)
+			degree[graphEdges[e]]++;
+		return degree;
+	}
+
+	// Breadth first over out-edges; Cuthill-McKee when byDegree is set
+	void bfsOrder(const std::vector<uint32_t> &graphOffsets,
+			const uint32_t *graphEdges, bool byDegree)
+	{
+		unsigned n = graphOffsets.size() - 1;
+		std::vector<uint32_t> degree;
+		std::vector<uint32_t> roots(n);
+		for (unsigned v = 0; v != n; v++)
+			roots[v] = v;
+		if (byDegree) {
+			degree = inDegrees(graphOffsets, graphEdges);
+			for (unsigned v = 0; v != n; v++)
+				degree[v] += graphOffsets[v + 1] - graphOffsets[v];
+			std::stable_sort(roots.begin(), roots.end(), [&](uint32_t a, uint32_t b) {
+				return degree[a] < degree[b];
+			});
+		}
+
+		order.clear();
+		order.reserve(n);
+		std::vector<bool> visited(n, false);
+		for (uint32_t root: roots) {
+			if (visited[root])
+				continue;
+			visited[root] = true;
+			order.push_back(root);
+			for (size_t head = order.size() - 1; head != order.size(); head++) {
+				uint32_t v = order[head];
+				size_t first = order.size();
+				for (uint32_t e = graphOffsets[v]; e != graphOffsets[v + 1]; e++) {
+					uint32_t w = graphEdges[e];
+					if (!visited[w]) {
+						visited[w] = true;
+						order.push_back(w);
+					}
+				}
+				if (byDegree)
+					std::stable_sort(order.begin() + first, order.end(), [&](uint32_t a, uint32_t b) {
+						return degree[a] < degree[b];
+					});
+			}
+		}
+		if (byDegree)
+			std::reverse(order.begin(), order.end());
+	}
+
+	void degreeOrder(const std::vector<uint32_t> &graphOffsets, const uint32_t *graphEdges)
+	{
+		std::vector<uint32_t> degree = inDegrees(graphOffsets, graphEdges);
+		order.resize(degree.size());
+		for (unsigned v = 0; v != order.size(); v++)
+			order[v] = v;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return degree[a] > degree[b];
+		});
+	}
+};
+
+#endif
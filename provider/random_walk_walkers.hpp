@@ -0,0 +1,210 @@
+#ifndef random_walk_walkers_hpp
+#define random_walk_walkers_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+
+/* Walks a group of independent samples at once, one step of each in turn.
+
+   A step needs two dependent loads, the edge range of the current node and
+   then the chosen edge, so every round first picks the edges of all the
+   walks, prefetching them, then follows the edges of all the walks,
+   prefetching the edge ranges and counters of the nodes they reach. With
+   Group walks in flight each load has the rest of the round to arrive. A walk
+   that finishes is replaced by the next sample straight away. Every node is
+   counted exactly as often as a one-at-a-time walk would count it. */
+template<unsigned Group = 16>
+class RandomWalkInterleaved
+{
+public:
+	static_assert(Group >= 1 && Group <= 64, "RandomWalkInterleaved - group size out of range.");
+
+	// Walk samples [0, n), counting every visit in count and choosing edges with pick
+	template<class TPick, class TEdges, class TCounter>
+	static void walk(const TPick &pick, const TEdges &edges, TCounter &count,
+			const unsigned *seeds, const unsigned *starts, unsigned n, unsigned length)
+	{
+		if (length == 0)
+			return;
+
+		uint32_t current[Group], rng[Group], edge[Group];
+		unsigned left[Group];
+		unsigned next = 0, active = 0;
+		for (unsigned k = 0; k != Group; k++) {
+			left[k] = 0;
+			if (next != n) {
+				start(k, current, rng, left, seeds, starts, next++, length, pick);
+				active++;
+			}
+		}
+
+		while (active) {
+			for (unsigned k = 0; k != Group; k++) {
+				if (!left[k])
+					continue;
+				uint32_t node = current[k];
+				count(node);
+				edge[k] = pick(node, rng[k]);
+				rng[k] = rng[k] * 1664525 + 1013904223;
+				edges.prefetch(edge[k]);
+			}
+			for (unsigned k = 0; k != Group; k++) {
+				if (!left[k])
+					continue;
+				uint32_t node = edges[edge[k]];
+				current[k] = node;
+				pick.prefetch(node);
+				count.prefetch(node);
+				if (--left[k] == 0) {
+					if (next != n)
+						start(k, current, rng, left, seeds, starts, next++, length, pick);
+					else
+						active--;
+				}
+			}
+		}
+	}
+
+private:
+	template<class TPick>
+	static void start(unsigned k, uint32_t *current, uint32_t *rng, unsigned *left,
+			const unsigned *seeds, const unsigned *starts, unsigned sample, unsigned length,
+			const TPick &pick)
+	{
+		current[k] = starts[sample];
+		rng[k] = seeds[sample];
+		left[k] = length;
+		pick.prefetch(current[k]);
+	}
+};
+
+/* Bulk-synchronous walker for graphs much larger than the caches.
+
+   All walks live in a struct-of-arrays frontier (current node and rng state;
+   every walk has the same remaining length, so that is one round counter).
+   Each round advances every walk by one step, and the frontier is then
+   bucketed by ranges of current node with a parallel counting sort. The next
+   round visits the walks bucket by bucket, so the offsets, edges and counters
+   it touches stay within one cache-sized region of the graph at a time, and
+   the random accesses into DRAM become sequential passes over the frontier.
+   Walks are anonymous, so reordering them leaves the counts unchanged. */
+class RandomWalkFrontier
+{
+public:
+	// Target bytes of graph and counters covered by one bucket
+	static const size_t bucketBytes = 256 << 10;
+	static const unsigned maxBuckets = 1024;
+	// Walks kept in the frontier at once; more samples are walked in batches
+	static const unsigned maxFrontier = 1u << 22;
+	// Walks handed to one task
+	static const unsigned blockSize = 1u << 14;
+
+	// sortInterval is the number of rounds between re-bucketing the frontier
+	RandomWalkFrontier(const uint32_t *offsets, unsigned nodes, unsigned sortInterval = 1)
+		: m_sortInterval(std::max(1u, sortInterval))
+	{
+		size_t edgeCount = offsets[nodes];
+		// Offsets, counters and the average share of edges of one node
+		size_t nodeBytes = 2 * sizeof(uint32_t) + (nodes ? edgeCount * sizeof(uint32_t) / nodes : 0);
+		m_shift = 0;
+		while ((size_t(1) << m_shift) * nodeBytes < bucketBytes
+				|| (size_t(nodes) >> m_shift) >= maxBuckets)
+			m_shift++;
+		m_buckets = unsigned((size_t(nodes) >> m_shift) + 1);
+	}
+
+	unsigned buckets() const
+	{ return m_buckets; }
+
+	template<class THistogram, class TPick, class TEdges>
+	void walk(THistogram &histogram, const TPick &pick, const TEdges &edges,
+			const unsigned *seeds, const unsigned *starts, unsigned n, unsigned length)
+	{
+		for (unsigned first = 0; first < n; first += maxFrontier)
+			walkBatch(histogram, pick, edges, seeds + first, starts + first,
+					std::min(unsigned(maxFrontier), n - first), length);
+	}
+
+private:
+	unsigned m_sortInterval;
+	unsigned m_shift, m_buckets;
+
+	std::vector<uint32_t> m_current, m_rng, m_nextCurrent, m_nextRng;
+	std::vector<size_t> m_bucketOffsets;
+
+	template<class THistogram, class TPick, class TEdges>
+	void walkBatch(THistogram &histogram, const TPick &pick, const TEdges &edges,
+			const unsigned *seeds, const unsigned *starts, unsigned n, unsigned length)
+	{
+		if (length == 0 || n == 0)
+			return;
+		m_current.assign(starts, starts + n);
+		m_rng.assign(seeds, seeds + n);
+		m_nextCurrent.resize(n);
+		m_nextRng.resize(n);
+		unsigned blocks = (n + blockSize - 1) / blockSize;
+		m_bucketOffsets.resize(size_t(blocks) * m_buckets);
+
+		countBuckets(blocks, n);
+		scatter(blocks, n);
+		for (unsigned round = 0; round != length; round++) {
+			bool sort = round + 1 != length && (round + 1) % m_sortInterval == 0;
+			tbb::parallel_for(0u, blocks, [&](unsigned b) {
+				typename THistogram::Counter &count = histogram.local();
+				size_t *bucketCount = &m_bucketOffsets[size_t(b) * m_buckets];
+				if (sort)
+					std::fill(bucketCount, bucketCount + m_buckets, 0);
+				uint32_t *current = m_current.data(), *rng = m_rng.data();
+				for (unsigned i = b * blockSize, end = std::min(n, i + blockSize); i < end; i++) {
+					uint32_t node = current[i];
+					count(node);
+					node = edges[pick(node, rng[i])];
+					rng[i] = rng[i] * 1664525 + 1013904223;
+					current[i] = node;
+					if (sort)
+						bucketCount[node >> m_shift]++;
+				}
+			});
+			if (sort)
+				scatter(blocks, n);
+		}
+	}
+
+	void countBuckets(unsigned blocks, unsigned n)
+	{
+		tbb::parallel_for(0u, blocks, [&](unsigned b) {
+			size_t *bucketCount = &m_bucketOffsets[size_t(b) * m_buckets];
+			std::fill(bucketCount, bucketCount + m_buckets, 0);
+			for (unsigned i = b * blockSize, end = std::min(n, i + blockSize); i < end; i++)
+				bucketCount[m_current[i] >> m_shift]++;
+		});
+	}
+
+	// Stable counting sort of the frontier by bucket, from per-block counts
+	void scatter(unsigned blocks, unsigned n)
+	{
+		size_t sum = 0;
+		for (unsigned d = 0; d != m_buckets; d++) {
+			for (unsigned b = 0; b != blocks; b++) {
+				size_t c = m_bucketOffsets[size_t(b) * m_buckets + d];
+				m_bucketOffsets[size_t(b) * m_buckets + d] = sum;
+				sum += c;
+			}
+		}
+		tbb::parallel_for(0u, blocks, [&](unsigned b) {
+			size_t *offset = &m_bucketOffsets[size_t(b) * m_buckets];
+			for (unsigned i = b * blockSize, end = std::min(n, i + blockSize); i < end; i++) {
+				size_t j = offset[m_current[i] >> m_shift]++;
+				m_nextCurrent[j] = m_current[i];
+				m_nextRng[j] = m_rng[i];
+			}
+		});
+		m_current.swap(m_nextCurrent);
+		m_rng.swap(m_nextRng);
+	}
+};
+
+#endif
@@ -6,6 +6,7 @@
 
 #include <tbb/parallel_for.h>
 #include "puzzler/puzzles/ising_spin.hpp"
+#include "puzzler/core/mt19937.hpp"
 
 // Work around deprecation warnings
 #define CL_USE_DEPRECATED_OPENCL_1_1_APIS 
@@ -154,10 +155,9 @@ public:
 
 			log->LogInfo("Starting steps.");
 
-			std::mt19937 rng(pInput->seed); // Gives the same sequence on all platforms
+			// The same sequence as std::mt19937(seed)
 			std::vector<uint32_t> seeds(pInput->repeats);
-			for (uint32_t &seed: seeds)
-				seed = rng();
+			puzzler::Mt19937Fill(pInput->seed, seeds.data(), seeds.size());
 			// kernel.setArg(0, n);
 			// kernel.setArg(2, pInput->maxTime);
 			// kernel.setArg(3, pInput->repeats);
@@ -310,10 +310,9 @@ cpu:
 
 			log->LogInfo("Starting steps.");
 
-			std::mt19937 rng(pInput->seed); // Gives the same sequence on all platforms
+			// The same sequence as std::mt19937(seed)
 			std::vector<uint32_t> seeds(pInput->repeats);
-			for (uint32_t &seed: seeds)
-				seed = rng();
+			puzzler::Mt19937Fill(pInput->seed, seeds.data(), seeds.size());
 			tbb::parallel_for(0u, pInput->repeats, [=, &seeds, &log, &sums, &sumSquares](unsigned i){
 				std::vector<int> current(n*n), next(n*n);
 				uint32_t seed = seeds[i];
@@ -1,8 +1,17 @@
 #ifndef user_logic_sim_hpp
 #define user_logic_sim_hpp
 
+#include <tbb/cache_aligned_allocator.h>
 #include <tbb/parallel_for.h>
+
 #include "puzzler/puzzles/logic_sim.hpp"
+#include "logic_sim_netlist.hpp"
+#include "logic_sim_optimise.hpp"
+#include "logic_sim_reorder.hpp"
+#include "logic_sim_event.hpp"
+#include "logic_sim_bytecode.hpp"
+#include "logic_sim_cache.hpp"
+#include "logic_sim_cache_model.hpp"
 
 class LogicSimProvider
 : public puzzler::LogicSimPuzzle
@@ -16,55 +25,184 @@ public:
 			const puzzler::LogicSimInput *pInput,
 			puzzler::LogicSimOutput *pOutput
 			) const override {
+		LogicSimNetlist netlist;
+		compile(log, pInput, netlist);
+		log->LogVerbose("Netlist has %u gates in %u levels", netlist.gateCount(), netlist.levelCount());
+
+		char *str;
+		if ((str = getenv("HPCE_LOGIC_SIM_CACHE_MODEL")) != NULL && atoi(str) != 0) {
+			// Second of two sweeps, so the counts are for a warm cache
+			std::vector<uint8_t> values(netlist.valueCount()), next(netlist.flipFlopCount);
+			LogicSimCacheModel model;
+			model.sweep(netlist, values.data(), next.data());
+			model.reset();
+			model.sweep(netlist, values.data(), next.data());
+			log->LogInfo("Modelled sweep: %llu accesses, %llu L1 misses, %llu L2 misses",
+					(unsigned long long)model.accesses, (unsigned long long)model.l1Misses,
+					(unsigned long long)model.l2Misses);
+		}
+
+		// Netlists too narrow to sweep in parallel run as straight-line bytecode,
+		// larger ones use the event-driven engine with parallel sweeps
+		unsigned widest = 0;
+		for (unsigned l = 0; l != netlist.levelCount(); l++)
+			widest = std::max(widest, netlist.levels[l + 1] - netlist.levels[l]);
+		std::string engine = widest < LogicSimNetlist::parallelWidth ? "bytecode" : "event";
+		if ((str = getenv("HPCE_LOGIC_SIM_ENGINE")) != NULL)
+			engine = str;
+		log->LogVerbose("Using %s engine", engine.c_str());
+
+		if (engine == "bytecode") {
+			LogicSimProgram program(netlist);
+			log->LogVerbose("Compiled %u ops over %u registers", program.opCount(), program.registerCount);
+			std::vector<uint8_t> regs(program.registerCount);
+			run(log, pInput, netlist, &regs[0], [&](uint8_t *state, uint8_t *next) {
+				program.step(state, next);
+			}, pOutput);
+		} else if (engine == "level") {
+			std::vector<uint8_t> values(netlist.valueCount());
+			run(log, pInput, netlist, &values[0], [&](uint8_t *state, uint8_t *next) {
+				netlist.step(state, next);
+			}, pOutput);
+		} else if (engine == "event") {
+			LogicSimEventEngine events(netlist);
+			std::vector<uint8_t> values(netlist.valueCount());
+			run(log, pInput, netlist, &values[0], [&](uint8_t *state, uint8_t *) {
+				events.step(state);
+			}, pOutput);
+			log->LogVerbose("%u event-driven cycles, %u full sweeps", events.eventCycles(), events.sweepCycles());
+		} else {
+			throw std::runtime_error("LogicSimProvider::Execute - unknown engine '" + engine + "'.");
+		}
+	}
+
+	virtual std::vector<std::shared_ptr<puzzler::LogicSimOutput> > ExecuteBatch(
+			puzzler::ILog *log,
+			const puzzler::LogicSimInput *pInput,
+			const std::vector<std::vector<bool> > &inputStates
+			) const override {
+		LogicSimNetlist netlist;
+		compile(log, pInput, netlist);
+		unsigned n = netlist.flipFlopCount;
+		for (const std::vector<bool> &state: inputStates)
+			if (state.size() != n)
+				throw std::runtime_error("LogicSimProvider::ExecuteBatch - state size is inconsistent.");
+
+		std::vector<std::shared_ptr<puzzler::LogicSimOutput> > outputs(inputStates.size());
+		for (auto &output: outputs) {
+			output = std::make_shared<puzzler::LogicSimOutput>(this, pInput);
+			output->outputState.resize(n);
+		}
+
+		const unsigned lanes = LogicSimLanes<logic_sim_lane_t>::count;
+		unsigned passes = (inputStates.size() + lanes - 1) / lanes;
+		log->LogVerbose("Simulating %u states in %u passes of %u", (unsigned)inputStates.size(), passes, lanes);
+		tbb::parallel_for(0u, passes, [&](unsigned p) {
+			unsigned first = p * lanes;
+			unsigned count = std::min<unsigned>(lanes, inputStates.size() - first);
+			executeSliced<logic_sim_lane_t>(netlist, pInput->clockCycles,
+					&inputStates[first], &outputs[first], count);
+		});
+		return outputs;
+	}
+
+protected:
+	// Optimise, reorder for locality, then levelise, the netlist of an input,
+	// reusing a cached result when there is one
+	void compile(puzzler::ILog *log, const puzzler::LogicSimInput *pInput, LogicSimNetlist &netlist) const
+	{
+		bool reorder = true;
+		char *str;
+		if ((str = getenv("HPCE_LOGIC_SIM_REORDER")) != NULL)
+			reorder = atoi(str) != 0;
+
+		LogicSimNetlistCache cache(pInput, reorder);
+		LogicSimNetlistCache::Stats stats;
+		if (cache.load(netlist, stats)) {
+			log->LogInfo("Loaded netlist %016llx from cache, optimised from %u to %u gates",
+					(unsigned long long)cache.key(), stats.gatesBefore, stats.gatesAfter);
+			return;
+		}
+
+		log->LogVerbose("Optimising netlist");
+		LogicSimOptimiser optimiser(pInput);
+		log->LogInfo("Optimised netlist from %u to %u gates (%u dead, %u folded, %u shared)",
+				optimiser.gatesBefore, optimiser.gatesAfter,
+				optimiser.deadGates, optimiser.foldedGates, optimiser.sharedGates);
+
+		unsigned n = pInput->flipFlopInputs.size();
+		if (reorder) {
+			log->LogVerbose("Reordering netlist");
+			LogicSimReorder order(n, optimiser.xorGateInputs, optimiser.flipFlopInputs);
+			log->LogVerbose("Levelising netlist");
+			netlist.compile(n, order.xorGateInputs, order.flipFlopInputs);
+			netlist.flipFlopOrigin = order.flipFlopOrigin;
+		} else {
+			log->LogVerbose("Levelising netlist");
+			netlist.compile(n, optimiser.xorGateInputs, optimiser.flipFlopInputs);
+		}
+
+		if (cache.enabled() && !cache.store(netlist, optimiser))
+			log->LogVerbose("Could not write netlist %016llx to cache", (unsigned long long)cache.key());
+	}
+
+	// Clock the flip-flops held at the start of state, in netlist order, through every cycle
+	template<class TStep>
+	void run(puzzler::ILog *log, const puzzler::LogicSimInput *pInput, const LogicSimNetlist &netlist,
+			uint8_t *state, TStep step, puzzler::LogicSimOutput *pOutput) const
+	{
+		unsigned n = pInput->flipFlopInputs.size();
+		const uint32_t *origin = netlist.flipFlopOrigin.data();
+		std::vector<uint8_t> next(n);
+		for (unsigned i = 0; i != n; i++)
+			state[i] = pInput->inputState[origin[i]];
+
 		log->LogVerbose("About to start running clock cycles (total = %d", pInput->clockCycles);
-		std::vector<bool> state=pInput->inputState;
 		for(unsigned i=0; i<pInput->clockCycles; i++){
 			log->LogVerbose("Starting iteration %d of %d\n", i, pInput->clockCycles);
 
-			state=next(state, pInput);
+			step(state, next.data());
 
 			// The weird form of log is so that there is little overhead
 			// if logging is disabled
 			log->Log(puzzler::Log_Debug,[&](std::ostream &dst) {
-					for(unsigned i=0; i<state.size(); i++){
-					dst<<state[i];
+					std::vector<bool> original(n);
+					for(unsigned i=0; i<n; i++){
+					original[origin[i]]=state[i];
+					}
+					for(unsigned i=0; i<n; i++){
+					dst<<original[i];
 					}
 					});
 		}
 
 		log->LogVerbose("Finished clock cycles");
 
-		pOutput->outputState=state;
+		pOutput->outputState.resize(n);
+		for (unsigned i = 0; i != n; i++)
+			pOutput->outputState[origin[i]] = state[i];
 	}
 
-protected:
-
-	bool calcSrc(unsigned src, const std::vector<bool> &state, const puzzler::LogicSimInput *input) const
+	// Simulate up to one word of stimuli together, one bit per stimulus
+	template<class W>
+	void executeSliced(const LogicSimNetlist &netlist, unsigned cycles,
+			const std::vector<bool> *states,
+			std::shared_ptr<puzzler::LogicSimOutput> *outputs, unsigned count) const
 	{
-		if(src < state.size()){
-			return state.at(src);
-		}else{
-			unsigned xorSrc=src - state.size();
-			bool a=calcSrc(input->xorGateInputs.at(xorSrc).first, state, input);
-			bool b=calcSrc(input->xorGateInputs.at(xorSrc).second, state, input);
-			return a != b;
-		}
-	}
+		typedef LogicSimLanes<W> lanes;
+		unsigned n = netlist.flipFlopCount;
+		std::vector<W, tbb::cache_aligned_allocator<W> > values(netlist.valueCount(), W()), next(n);
+		for (unsigned k = 0; k != count; k++)
+			for (unsigned i = 0; i != n; i++)
+				if (states[k][netlist.flipFlopOrigin[i]])
+					lanes::set(values[i], k);
 
-	std::vector<bool> next(const std::vector<bool> &state, const puzzler::LogicSimInput *input) const
-	{
-		std::vector<bool> res(state.size());
-		std::vector<unsigned> res_c(state.size());
-		unsigned k = state.size();
-		tbb::parallel_for(0u, k, [&](unsigned i){
-		// for(unsigned i=0; i<res.size(); i++){
-			res_c[i]=(unsigned)calcSrc(input->flipFlopInputs[i], state, input);
-		});
-		for(unsigned i = 0; i < k; i++)
-		{
-			res[i] = (bool)res_c[i];
-		}
-		return res;
+		for (unsigned c = 0; c != cycles; c++)
+			netlist.step(values.data(), next.data());
+
+		for (unsigned k = 0; k != count; k++)
+			for (unsigned i = 0; i != n; i++)
+				outputs[k]->outputState[netlist.flipFlopOrigin[i]] = lanes::get(values[i], k);
 	}
 };
 
@@ -3,8 +3,15 @@
 
 #include <tbb/parallel_for.h>
 #include "puzzler/puzzles/random_walk.hpp"
+#include "random_walk_histogram.hpp"
+#include "radix_sort.hpp"
+#include "random_walk_walkers.hpp"
+#include "random_walk_relabel.hpp"
+#include "random_walk_pick.hpp"
+#include "random_walk_edges.hpp"
 
 #include <fstream>
+#include <sstream>
 
 // Update: this doesn't work in windows - if necessary take it out. It is in
 // here because some unix platforms complained if it wasn't heere.
@@ -59,42 +66,90 @@ public:
 #endif	// DEBUG_CL
 	}
 
+	/* With HPCE_RANDOM_WALK_GRAPH=<path> set, the edges of inputs to be
+	   executed are walked from a file, the input's own where it is mapped
+	   and otherwise one next to path, so they need not fit in memory. */
+	virtual std::shared_ptr<Input> LoadInputToExecute(std::string format, std::string name, PersistContext &ctxt) const override
+	{
+		const char *path = getenv("HPCE_RANDOM_WALK_GRAPH");
+		return std::make_shared<RandomWalkInput>(format, name, ctxt, path ? path : "");
+	}
+
 	virtual void Execute(
 		puzzler::ILog *log,
 		const puzzler::RandomWalkInput *pInput,
 		puzzler::RandomWalkOutput *pOutput
 	) const override {
 
-		const std::vector<dd_node_t> &nodes(pInput->nodes);
+		unsigned nodesCount = pInput->NodeCount();
 
 		log->Log(Log_Debug, [&](std::ostream &dst){
-			dst<<"  Scale = "<<nodes.size()<<"\n";
-			for(unsigned i=0;i<nodes.size();i++){
+			const std::vector<uint32_t> &offsets(pInput->graphOffsets);
+			dst<<"  Scale = "<<nodesCount<<"\n";
+			for(unsigned i=0;i<nodesCount;i++){
 				dst<<"  "<<i<<" -> [";
-				for(unsigned j=0;j<nodes[i].edges.size();j++){
-					if(j!=0)
+				for(unsigned j=offsets[i];j<offsets[i+1];j++){
+					if(j!=offsets[i])
 						dst<<",";
-					dst<<nodes[i].edges[j];
+					dst<<pInput->Edges()[j];
 				}
 				dst<<"]\n";
 			}
 		});
 
-		unsigned nodesCount = nodes.size();
-		unsigned edgesCount = nodes[0].edges.size();
 		unsigned length = pInput->lengthWalks;	// All paths the same length
 
-		// This gives the same sequence on all platforms
-		std::mt19937 rng(pInput->seed);
+		// Usually drawn while the input was received
+		std::vector<unsigned> seeds(pInput->sampleSeeds);
+		std::vector<unsigned> starts(pInput->sampleStarts);
+		if (seeds.size() != pInput->numSamples || starts.size() != pInput->numSamples)
+			pInput->GenerateSamples(nodesCount, seeds, starts);
 
-		std::vector<unsigned> seeds(pInput->numSamples);
-		std::vector<unsigned> starts(pInput->numSamples);
-		for(unsigned i=0; i<pInput->numSamples; i++){
-			seeds[i] = rng();
-			starts[i] = rng() % nodesCount;    // Choose a random node
+		// Optionally walk a relabelled copy of the graph, mapping counts back at the end
+		RandomWalkRelabel relabel;
+		std::string relabelMode = "none";
+		char *str;
+		if ((str = getenv("HPCE_RANDOM_WALK_RELABEL")) != NULL)
+			relabelMode = str;
+		if (relabelMode != "none") {
+			bool cached = relabel.build(relabelMode, pInput->graphOffsets, pInput->Edges());
+			log->LogVerbose("Relabelled graph by %s%s", relabelMode.c_str(), cached ? " (cached order)" : "");
+			for (unsigned &start: starts)
+				start = relabel.rank[start];
+		}
+		const std::vector<uint32_t> &offsets(relabel.empty() ? pInput->graphOffsets : relabel.offsets);
+		const uint32_t *edges = relabel.empty() ? pInput->Edges() : relabel.edges.data();
+		size_t edgeCount = offsets.back();
+
+		// Edges the input left in a file are paged in as walks reach them,
+		// so read-ahead would only fetch pages no walk wants
+		bool graphFile = relabel.empty() && pInput->EdgesMapped();
+		if (graphFile) {
+			pInput->AdviseEdges(SpillFile::Random);
+			if ((str = getenv("HPCE_RANDOM_WALK_HUGEPAGES")) != NULL && atoi(str))
+				pInput->AdviseEdges(SpillFile::HugePages);
+			log->LogVerbose("Walking %.1f MB of edges mapped from %s", edgeCount * sizeof(uint32_t) / 1048576.0,
+					pInput->graphEdgeView ? "the input" : "a file");
 		}
 
-		if (nodesCount < 4000)
+		std::string engine = graphFile ? "frontier" : nodesCount < 4000 ? "interleaved" : "opencl";
+		if ((str = getenv("HPCE_RANDOM_WALK_ENGINE")) != NULL)
+			engine = str;
+		log->LogVerbose("Using %s walker", engine.c_str());
+
+		// Edge selection without a divide, specialised on the degrees of this graph
+		uint32_t uniformDegree = randomWalkUniformDegree(offsets);
+		std::string pick = uniformDegree == 0 ? "variable"
+				: (uniformDegree & (uniformDegree - 1)) == 0 ? "mask" : "fixed";
+		if ((str = getenv("HPCE_RANDOM_WALK_PICK")) != NULL)
+			pick = str;
+		if ((pick == "mask" && (uniformDegree == 0 || (uniformDegree & (uniformDegree - 1)) != 0))
+				|| (pick == "fixed" && uniformDegree == 0)
+				|| (pick != "mask" && pick != "fixed" && pick != "variable" && pick != "divide"))
+			throw std::runtime_error("RandomWalkProvider::Execute - edge selection '" + pick + "' does not fit this graph.");
+		log->LogVerbose("Selecting edges by %s (degree %u)", pick.c_str(), uniformDegree);
+
+		if (engine != "opencl")
 			goto cpu;
 
 		try {
@@ -107,7 +162,6 @@ public:
 
 			// Select an OpenCL platform
 			int selectedPlatform = 0;
-			char *str;
 			if ((str = getenv("HPCE_SELECT_PLATFORM")) != NULL)
 				selectedPlatform = atoi(str);
 			cl::Platform platform(platforms.at(selectedPlatform));
@@ -141,9 +195,6 @@ public:
 			if ((str = getenv("HPCE_SELECT_DEVICE")) != NULL)
 				selectedDevice = atoi(str);
 			cl::Device device = devices.at(selectedDevice);
-			//size_t globalmem = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
-			size_t allocmem = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
-			//std::clog << "Global memory: " << globalmem << ", alloc: " << allocmem << std::endl;
 
 			log->Log(Log_Debug, [&](std::ostream &dst) {
 				dst << "Found " << devices.size() << " devices\n";
@@ -171,36 +222,38 @@ public:
 			cl::Buffer buffStarts(context, CL_MEM_READ_ONLY, sizeof(unsigned) * starts.size());
 			queue.enqueueWriteBuffer(buffStarts, CL_FALSE, 0, sizeof(unsigned) * starts.size(), starts.data());
 
-			cl::Buffer buffEdges(context, CL_MEM_READ_ONLY, sizeof(unsigned) * nodesCount * edgesCount);
+			cl::Buffer buffOffsets(context, CL_MEM_READ_ONLY, sizeof(uint32_t) * offsets.size());
+			queue.enqueueWriteBuffer(buffOffsets, CL_FALSE, 0, sizeof(uint32_t) * offsets.size(), offsets.data());
 
-			std::vector<uint32_t> counts(nodesCount);
-			std::vector<unsigned> edges(nodesCount * edgesCount);
-			//unsigned /**cptr = counts.data(),*/ *eptr = edges.data();
-			uint32_t offset = 0;
-			for (const dd_node_t &node: nodes) {
-				//*cptr++ = node.count;
-				/*for (const uint32_t &edge: node.edges) {
-					*eptr++ = edge;
-				}*/
-				queue.enqueueWriteBuffer(buffEdges, CL_FALSE, offset, \
-						sizeof(unsigned) * edgesCount, node.edges.data());
-				offset += sizeof(unsigned) * edgesCount;
+			// Per-node fastmod multipliers, only read when the degrees differ
+			std::vector<uint64_t> multipliers(1, 0);
+			if (pick == "variable") {
+				multipliers.resize(nodesCount);
+				for (unsigned v = 0; v != nodesCount; v++)
+					multipliers[v] = randomWalkFastmodMultiplier(offsets[v + 1] - offsets[v]);
 			}
+			cl::Buffer buffMultipliers(context, CL_MEM_READ_ONLY, sizeof(uint64_t) * multipliers.size());
+			queue.enqueueWriteBuffer(buffMultipliers, CL_FALSE, 0, sizeof(uint64_t) * multipliers.size(), multipliers.data());
 
-			//cl::Buffer buffEdges(context, CL_MEM_READ_ONLY, sizeof(unsigned) * edges.size());
-			//queue.enqueueWriteBuffer(buffEdges, CL_FALSE, 0, sizeof(unsigned) * edges.size(), edges.data());
+			// At least one element, as empty buffers are invalid
+			cl::Buffer buffEdges(context, CL_MEM_READ_ONLY, sizeof(uint32_t) * std::max<size_t>(1, edgeCount));
+			if (edgeCount)
+				queue.enqueueWriteBuffer(buffEdges, CL_FALSE, 0, sizeof(uint32_t) * edgeCount, edges);
 
-			// Split working buffer because of CL_DEVICE_MAX_MEM_ALLOC_SIZE limitation
-			uint32_t blockSize = allocmem / sizeof(uint32_t) / nodesCount;
-			blockSize = std::min(blockSize, pInput->numSamples);
-			uint32_t blockCount = (pInput->numSamples + blockSize - 1) / blockSize;
+			std::vector<uint32_t> counts(nodesCount);
 
-			// Summarise and output buffer
-			cl::Buffer buffSum(context, CL_MEM_READ_WRITE, sizeof(uint32_t) * nodesCount * blockCount);
-			//queue.enqueueWriteBuffer(buffSum, CL_FALSE, 0, sizeof(uint32_t) * counts.size(), counts.data());
+			// One histogram for every walk, counted with atomics; work-groups
+			// count into local memory first when the whole histogram fits there
+			size_t localmem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+			std::string histogramMode = sizeof(uint32_t) * nodesCount <= localmem ? "local" : "atomic";
+			if ((str = getenv("HPCE_RANDOM_WALK_CL_HISTOGRAM")) != NULL)
+				histogramMode = str;
+			if ((histogramMode == "local" && sizeof(uint32_t) * nodesCount > localmem)
+					|| (histogramMode != "local" && histogramMode != "atomic"))
+				throw std::runtime_error("RandomWalkProvider::Execute - histogram '" + histogramMode + "' does not fit this device.");
+			log->LogVerbose("Counting visits in a %s histogram", histogramMode.c_str());
 
-			// The working buffer
-			cl::Buffer buffCount(context, CL_MEM_READ_WRITE, sizeof(uint32_t) * nodesCount * blockSize);
+			cl::Buffer buffCount(context, CL_MEM_READ_WRITE, sizeof(uint32_t) * nodesCount);
 
 			// Create and compile OpenCL program
 			std::string kernelSource = LoadSource("random_walk.cl");
@@ -209,7 +262,14 @@ public:
 
 			cl::Program program(context, sources);
 			try {
-				program.build(devices);
+				std::ostringstream options;
+				if (pick == "mask")
+					options << "-DRW_DEGREE=" << uniformDegree << "u -DRW_DEGREE_MASK=" << uniformDegree - 1 << "u";
+				else if (pick == "fixed")
+					options << "-DRW_DEGREE=" << uniformDegree << "u -DRW_DEGREE_M=" << randomWalkFastmodMultiplier(uniformDegree) << "ul";
+				else if (pick == "divide")
+					options << "-DRW_PICK_DIVIDE";
+				program.build(devices, options.str().c_str());
 			} catch (...) {
 				for (unsigned i = 0; i < devices.size(); i++) {
 					std::cerr << "Log for device " << devices[i].getInfo<CL_DEVICE_NAME>() << ":\n\n";
@@ -218,57 +278,52 @@ public:
 				throw;
 			}
 
-			// Create kernel
-			cl::Kernel kernel(program, "random_walk");
-			cl::Kernel kernel_comb(program, "random_walk_comb");
+			// Create kernels
+			cl::Kernel kernel_clear(program, "random_walk_clear");
+			cl::Kernel kernel(program, histogramMode == "local" ? "random_walk_local" : "random_walk");
 
-			// Set kernel parameters
-			kernel.setArg(0, buffEdges);
-			kernel.setArg(1, buffCount);
-			kernel.setArg(2, buffSeeds);
-			kernel.setArg(3, buffStarts);
-			kernel.setArg(4, length);
-			kernel.setArg(5, nodesCount);
-			kernel.setArg(6, edgesCount);
-
-			kernel_comb.setArg(1, buffCount);
-			kernel_comb.setArg(3, buffSum);
-
-			// Execute the kernel
-			for (uint32_t i = 0; i != blockCount; i++) {
-				uint32_t size = std::min(blockSize, pInput->numSamples - i * blockSize);
-				//queue.enqueueFillBuffer(buffCount, 0u, 0, size * nodesCount * sizeof(uint32_t));
-				kernel.setArg(7, i * blockSize);
-				cl::NDRange offset(0);			// Iteration starting offset
-				cl::NDRange globalSize(size);		// Global size
-				cl::NDRange localSize = cl::NullRange;	// Local work-groups N/A
-				//queue.enqueueBarrier();
-				queue.enqueueNDRangeKernel(kernel, offset, globalSize, localSize);
-				kernel_comb.setArg(0, size);
-				kernel_comb.setArg(2, i /*+ 1*/);
-				//queue.enqueueBarrier();
-				queue.enqueueNDRangeKernel(kernel_comb, cl::NDRange(0), cl::NDRange(nodesCount), cl::NullRange);
-			}
+			kernel_clear.setArg(0, buffCount);
+			queue.enqueueNDRangeKernel(kernel_clear, cl::NDRange(0), cl::NDRange(nodesCount), cl::NullRange);
 
-			if (blockCount != 1) {
-				// Summarise
-				kernel_comb.setArg(0, blockCount /*+ 1*/);
-				kernel_comb.setArg(1, buffSum);
-				kernel_comb.setArg(2, 0);
-				kernel_comb.setArg(3, buffSum);
-				//queue.enqueueBarrier();
-				queue.enqueueNDRangeKernel(kernel_comb, cl::NDRange(0), cl::NDRange(nodesCount), cl::NullRange);
+			// Set kernel parameters
+			kernel.setArg(0, buffOffsets);
+			kernel.setArg(1, buffMultipliers);
+			kernel.setArg(2, buffEdges);
+			kernel.setArg(3, buffCount);
+			kernel.setArg(4, buffSeeds);
+			kernel.setArg(5, buffStarts);
+			kernel.setArg(6, length);
+			kernel.setArg(7, nodesCount);
+			kernel.setArg(8, pInput->numSamples);
+
+			// Execute the kernel, each work-item walking a strided subset of the samples
+			if (histogramMode == "local") {
+				// A few groups per compute unit, so zeroing and flushing the
+				// local histograms stays small next to the walks
+				size_t groupSize = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+				size_t groups = std::max<size_t>(1, std::min<size_t>(
+						(pInput->numSamples + groupSize - 1) / groupSize,
+						4 * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()));
+				kernel.setArg(9, cl::__local(sizeof(uint32_t) * nodesCount));
+				log->LogVerbose("Walking on %u work-groups of %u", unsigned(groups), unsigned(groupSize));
+				queue.enqueueNDRangeKernel(kernel, cl::NDRange(0),
+						cl::NDRange(groups * groupSize), cl::NDRange(groupSize));
+			} else {
+				queue.enqueueNDRangeKernel(kernel, cl::NDRange(0),
+						cl::NDRange(std::max(1u, pInput->numSamples)), cl::NullRange);
 			}
 
 			log->LogVerbose("Done random walks, converting histogram");
 
 			// Map the counts from the nodes back into an array
-			pOutput->histogram.resize(nodes.size());
+			pOutput->histogram.resize(nodesCount);
 
 			//queue.enqueueBarrier();
-			queue.enqueueReadBuffer(buffSum, CL_TRUE, 0, sizeof(uint32_t) * counts.size(), counts.data());
+			queue.enqueueReadBuffer(buffCount, CL_TRUE, 0, sizeof(uint32_t) * counts.size(), counts.data());
+			if (!relabel.empty())
+				relabel.restore(counts);
 
-			tbb::parallel_for((size_t)0, nodes.size(), [&](size_t i){
+			tbb::parallel_for((size_t)0, (size_t)nodesCount, [&](size_t i){
 			//for (size_t i = 0; i != nodes.size(); i++)
 				pOutput->histogram[i] = std::make_pair(uint32_t(counts[i]), uint32_t(i));
 			});
@@ -280,35 +335,57 @@ public:
 				std::cerr << it->second << std::endl;
 			else
 				std::cerr << "Unknown " << e.err() << std::endl;
-			return;
+			log->LogInfo("OpenCL failed, walking on the CPU");
+			engine = "interleaved";
 		} catch (const std::exception &e) {
 			std::cerr<<"Exception: "<<e.what()<<std::endl;
-			return;
+			log->LogInfo("OpenCL failed, walking on the CPU");
+			engine = "interleaved";
 		}
 
 cpu:		{
-			std::vector<uint32_t> count(pInput->numSamples * nodesCount);
-
-			//log->LogVerbose("Starting random walks");
-
-			tbb::parallel_for(0u, pInput->numSamples, [&, nodesCount, length, edgesCount](unsigned i){
-				random_walk(pInput->nodes, &count[i * nodesCount], seeds[i], starts[i], length, edgesCount);
-			});
+			// Optionally walk bit-packed edge lists, smaller but slower to decode
+			std::string edgeFormat = "plain";
+			if ((str = getenv("HPCE_RANDOM_WALK_EDGES")) != NULL)
+				edgeFormat = str;
+			if (edgeFormat != "plain" && edgeFormat != "packed")
+				throw std::runtime_error("RandomWalkProvider::Execute - unknown edge format '" + edgeFormat + "'.");
+
+			// Once packed the plain edges are not read again, so let go of
+			// them where this walk owns them: the relabelled copy, and the
+			// pages mapped from the input's graph file. An input held in
+			// memory is const here and keeps its copy.
+			auto dropPlain = [&]() {
+				if (!relabel.empty())
+					std::vector<uint32_t>().swap(relabel.edges);
+				if (pInput->EdgesMapped())
+					pInput->AdviseEdges(SpillFile::DontNeed);
+			};
+
+			std::vector<uint32_t> count;
+			if (pick == "divide") {
+				count = countVisits(log, engine, edgeFormat, RandomWalkPickDivide{offsets.data()}, offsets, edges, dropPlain, seeds, starts, length);
+			} else if (pick == "mask") {
+				count = countVisits(log, engine, edgeFormat, RandomWalkPickMask(uniformDegree), offsets, edges, dropPlain, seeds, starts, length);
+			} else if (pick == "fixed") {
+				count = countVisits(log, engine, edgeFormat, RandomWalkPickFixed(uniformDegree), offsets, edges, dropPlain, seeds, starts, length);
+			} else {
+				count = countVisits(log, engine, edgeFormat, RandomWalkPickVariable(offsets), offsets, edges, dropPlain, seeds, starts, length);
+			}
 
 			log->LogVerbose("Done random walks, converting histogram");
+			if (!relabel.empty())
+				relabel.restore(count);
 
 			// Map the counts from the nodes back into an array
-			pOutput->histogram.resize(nodes.size());
-			tbb::parallel_for((size_t)0, nodes.size(), [&](size_t i){
-				uint32_t cnt = 0;//nodes[i].count;
-				for (unsigned j = 0; j != pInput->numSamples; j++)
-					cnt += count[j * nodes.size() + i];
-				pOutput->histogram[i]=std::make_pair(uint32_t(cnt),uint32_t(i));
+			pOutput->histogram.resize(nodesCount);
+			tbb::parallel_for((size_t)0, (size_t)nodesCount, [&](size_t i){
+				pOutput->histogram[i]=std::make_pair(uint32_t(count[i]),uint32_t(i));
 			});
 		}
 done:
 		// Order them by how often they were visited
-		std::sort(pOutput->histogram.rbegin(), pOutput->histogram.rend());
+		sortHistogramDescending(pOutput->histogram);
 
 		// Debug only. No cost in normal execution
 		log->Log(Log_Debug, [&](std::ostream &dst){
@@ -323,21 +400,90 @@ done:
 protected:
 	/* Start from node start, then follow a random walk of length nodes, incrementing
 	   the count of all the nodes we visit. */
-	void random_walk(const std::vector<dd_node_t> &nodes, uint32_t *count, \
-			uint32_t seed, unsigned start, unsigned length, unsigned edgesCount) const
+	template<class TPick, class TEdges, class TCounter>
+	void random_walk(const TPick &pick, const TEdges &edges, TCounter &count, \
+			uint32_t seed, unsigned start, unsigned length) const
 	{
 		uint32_t rng=seed;
 		unsigned current=start;
 		while (length--) {
 			//nodes[current].count++;
-			count[current]++;
-			const dd_node_t &node = nodes[current];
-			unsigned edgeIndex = rng % edgesCount;
-			current = node.edges[edgeIndex];
+			count(current);
+			current = edges[pick(current, rng)];
 			rng = step(rng);
 		}
 	}
 
+	/* Count the visits of every walk on the edges in the given format. Packed
+	   edges are walked instead of the plain array, so dropPlain is called to
+	   release it once they are built. */
+	template<class TPick, class TDrop>
+	std::vector<uint32_t> countVisits(puzzler::ILog *log, const std::string &engine, const std::string &edgeFormat,
+			const TPick &pick, const std::vector<uint32_t> &offsets, const uint32_t *edges, TDrop dropPlain,
+			const std::vector<unsigned> &seeds, const std::vector<unsigned> &starts,
+			unsigned length) const
+	{
+		if (edgeFormat == "packed") {
+			size_t edgeCount = offsets.back();
+			RandomWalkPackedEdges packed(edges, edgeCount, offsets.size() - 1);
+			log->LogVerbose("Packed %u edges into %u bits each, %.1f MB instead of %.1f MB",
+					unsigned(edgeCount), packed.width(), packed.bytes() / 1048576.0,
+					edgeCount * sizeof(uint32_t) / 1048576.0);
+			dropPlain();
+			return countVisits(log, engine, pick, offsets, packed, seeds, starts, length);
+		}
+		return countVisits(log, engine, pick, offsets, RandomWalkEdges{edges}, seeds, starts, length);
+	}
+
+	// Count the visits of every walk, in private histograms merged at the end
+	template<class TPick, class TEdges>
+	std::vector<uint32_t> countVisits(puzzler::ILog *log, const std::string &engine, const TPick &pick,
+			const std::vector<uint32_t> &offsets, const TEdges &edges,
+			const std::vector<unsigned> &seeds, const std::vector<unsigned> &starts,
+			unsigned length) const
+	{
+		unsigned nodesCount = offsets.size() - 1;
+		if (RandomWalkDenseHistogram::fits(nodesCount)) {
+			RandomWalkDenseHistogram histogram(nodesCount);
+			walkSamples(engine, histogram, pick, offsets, edges, seeds, starts, length);
+			log->LogVerbose("Done random walks on %u private arrays, merging", histogram.workers());
+			return histogram.merge();
+		} else {
+			RandomWalkHashedHistogram histogram(nodesCount);
+			walkSamples(engine, histogram, pick, offsets, edges, seeds, starts, length);
+			log->LogVerbose("Done random walks on %u private tables, merging", histogram.workers());
+			return histogram.merge();
+		}
+	}
+
+	// Walk every sample, counting visits in the private counter of each worker
+	template<class THistogram, class TPick, class TEdges>
+	void walkSamples(const std::string &engine, THistogram &histogram, const TPick &pick,
+			const std::vector<uint32_t> &offsets, const TEdges &edges,
+			const std::vector<unsigned> &seeds, const std::vector<unsigned> &starts,
+			unsigned length) const
+	{
+		if (engine == "simple") {
+			tbb::parallel_for(tbb::blocked_range<unsigned>(0, seeds.size()),
+					[&](const tbb::blocked_range<unsigned> &r) {
+				typename THistogram::Counter &count = histogram.local();
+				for (unsigned i = r.begin(); i != r.end(); i++)
+					random_walk(pick, edges, count, seeds[i], starts[i], length);
+			});
+		} else if (engine == "interleaved") {
+			tbb::parallel_for(tbb::blocked_range<unsigned>(0, seeds.size()),
+					[&](const tbb::blocked_range<unsigned> &r) {
+				RandomWalkInterleaved<>::walk(pick, edges, histogram.local(),
+						&seeds[r.begin()], &starts[r.begin()], r.size(), length);
+			});
+		} else if (engine == "frontier") {
+			RandomWalkFrontier frontier(offsets.data(), offsets.size() - 1);
+			frontier.walk(histogram, pick, edges, seeds.data(), starts.data(), seeds.size(), length);
+		} else {
+			throw std::runtime_error("RandomWalkProvider::walkSamples - unknown engine '" + engine + "'.");
+		}
+	}
+
 private:
 	std::map<cl_int, std::string> errmap;
 
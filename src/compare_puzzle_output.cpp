@@ -9,7 +9,8 @@ int main(int argc, char *argv[])
    puzzler::PuzzleRegistrar::UserRegisterPuzzles();
 
    if(argc<2){
-      fprintf(stderr, "compare_puzzle_output ref got logLevel\n");
+      fprintf(stderr, "compare_puzzle_output ref got logLevel [input]\n");
+      fprintf(stderr, "  With input, ref may be - to take the reference from the result cache, or run and cache it.\n");
       std::cout<<"Puzzles:\n";
       puzzler::PuzzleRegistrar::ListPuzzles();
       exit(1);
@@ -27,19 +28,53 @@ int main(int argc, char *argv[])
       std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("execute_puzzle", logLevel);
       logDest->Log(puzzler::Log_Info, "Created log.");
 
-      logDest->LogInfo("Loading reference %s", refName.c_str());
+      /* The input lets a ref of - come from the result cache. Only outputs
+         of ReferenceExecute run here are added to it, never the ref file. */
+      std::shared_ptr<puzzler::Puzzle::Input> input;
+      puzzler::ResultCache cache(logDest.get());
+      std::string key;
+      if(argc>4){
+         logDest->LogInfo("Loading input %s", argv[4]);
+         puzzler::FileInStream file(argv[4]);
+         puzzler::BufferedStream buffered(&file);
+         puzzler::CompressedStream src(&buffered, false);
+         puzzler::PersistContext ctxt(&src, false);
+
+         input=puzzler::PuzzleRegistrar().LoadInput(ctxt);
+         if(cache.Covers(true) && refName=="-")
+            key=cache.Key(puzzler::ResultCache::ImplementationId(true), input.get());
+      }
+
       std::shared_ptr<puzzler::Puzzle::Output> ref;
-      {
-         puzzler::FileInStream src(refName);
+      if(refName!="-"){
+         logDest->LogInfo("Loading reference %s", refName.c_str());
+         puzzler::FileInStream file(refName);
+         puzzler::BufferedStream buffered(&file);
+         puzzler::CompressedStream src(&buffered, false);
          puzzler::PersistContext ctxt(&src, false);
 
          ref=puzzler::PuzzleRegistrar().LoadOutput(ctxt);
+      }else{
+         if(!input)
+            throw std::runtime_error("A reference of - needs an input.");
+         if(!key.empty())
+            ref=cache.Load(key, input.get());
+         if(!ref){
+            logDest->LogInfo("Executing reference");
+            auto puzzle=puzzler::PuzzleRegistrar::Lookup(input->PuzzleName());
+            ref=puzzle->MakeEmptyOutput(input.get());
+            puzzle->ReferenceExecute(logDest.get(), input.get(), ref.get());
+            if(!key.empty())
+               cache.Store(key, ref.get());
+         }
       }
       
       logDest->LogInfo("Loading got %s", gotName.c_str());
       std::shared_ptr<puzzler::Puzzle::Output> got;
       {
-         puzzler::FileInStream src(gotName);
+         puzzler::FileInStream file(gotName);
+         puzzler::BufferedStream buffered(&file);
+         puzzler::CompressedStream src(&buffered, false);
          puzzler::PersistContext ctxt(&src, false);
 
          got=puzzler::PuzzleRegistrar().LoadOutput(ctxt);
@@ -0,0 +1,77 @@
+
+#include "puzzler/puzzler.hpp"
+
+#include <iostream>
+
+
+int main(int argc, char *argv[])
+{
+   puzzler::PuzzleRegistrar::UserRegisterPuzzles();
+
+   if(argc<3){
+      fprintf(stderr, "convert_puzzle_format version logLevel < src > dst\n");
+      fprintf(stderr, "  Rewrites a puzzle input or output in format version 0 or 1.\n");
+      exit(1);
+   }
+
+   try{
+      unsigned version=atoi(argv[1]);
+      int logLevel=atoi(argv[2]);
+
+      std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("convert_puzzle_format", logLevel);
+      logDest->Log(puzzler::Log_Info, "Created log.");
+
+      // Inputs and outputs start the same way, so read the header to see which this is
+      std::shared_ptr<puzzler::Puzzle::Input> input;
+      std::shared_ptr<puzzler::Puzzle::Output> output;
+      {
+         puzzler::StdinStream in;
+         puzzler::BufferedStream buffered(&in);
+         puzzler::CompressedStream src(&buffered, false);
+         puzzler::PersistContext ctxt(&src, false);
+
+         std::string format, name;
+         ctxt.SendOrRecv(format).SendOrRecv(name);
+         auto puzzle=puzzler::PuzzleRegistrar::Lookup(name);
+         if(!puzzle)
+            throw std::runtime_error("No puzzle registered with name "+name);
+
+         if(format.compare(0, 13, "puzzle.input.")==0){
+            input=puzzle->LoadInput(format, name, ctxt);
+            logDest->LogInfo("Loaded %s input, format %u", name.c_str(), input->FormatVersion());
+         }else{
+            output=puzzle->LoadOutput(format, name, ctxt);
+            logDest->LogInfo("Loaded %s output, format %u", name.c_str(), output->FormatVersion());
+         }
+      }
+
+      logDest->LogInfo("Writing format %u to stdout", version);
+      {
+         puzzler::StdoutStream out;
+         puzzler::BufferedStream buffered(&out);
+         puzzler::CompressedStream dst(&buffered, puzzler::CompressedStream::Requested());
+         puzzler::PersistContext ctxt(&dst, true);
+
+         if(input){
+            input->SetFormatVersion(version);
+            input->Persist(ctxt);
+         }else{
+            output->SetFormatVersion(version);
+            output->Persist(ctxt);
+         }
+         dst.Flush();
+         buffered.Flush();
+      }
+   }catch(std::string &msg){
+      std::cerr<<"Caught error string : "<<msg<<std::endl;
+      return 1;
+   }catch(std::exception &e){
+      std::cerr<<"Caught exception : "<<e.what()<<std::endl;
+      return 1;
+   }catch(...){
+      std::cerr<<"Caught unknown exception."<<std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -37,9 +37,13 @@ int main(int argc, char *argv[])
 
       logDest->LogInfo("Writing data to stdout");
       {
-         puzzler::StdoutStream dst;
+         puzzler::StdoutStream out;
+         puzzler::BufferedStream buffered(&out);
+         puzzler::CompressedStream dst(&buffered, puzzler::CompressedStream::Requested());
          puzzler::PersistContext ctxt(&dst, true);
          input->Persist(ctxt);
+         dst.Flush();
+         buffered.Flush();
       }
    }catch(std::string &msg){
       std::cerr<<"Caught error string : "<<msg<<std::endl;
@@ -22,33 +22,53 @@ int main(int argc, char *argv[])
 
       std::shared_ptr<puzzler::Puzzle::Input> input;
       {
-         puzzler::StdinStream src;
+         puzzler::StdinStream in;
+         puzzler::BufferedStream buffered(&in);
+         puzzler::CompressedStream src(&buffered, false);
          puzzler::PersistContext ctxt(&src, false);
 
-         input=puzzler::PuzzleRegistrar().LoadInput(ctxt);
+         // Only the user's Execute may hold the input its own way
+         input=puzzler::PuzzleRegistrar().LoadInput(ctxt, !isReference);
       }
 
       logDest->Log(puzzler::Log_Info, "Loaded input, puzzle=%s", input->PuzzleName().c_str());
 
       auto puzzle=puzzler::PuzzleRegistrar().Lookup(input->PuzzleName());
 
-      auto output=puzzle->MakeEmptyOutput(input.get());
+      puzzler::ResultCache cache(logDest.get());
+      std::string key;
+      std::shared_ptr<puzzler::Puzzle::Output> output;
+      if(cache.Covers(isReference)){
+         key=cache.Key(puzzler::ResultCache::ImplementationId(isReference), input.get());
+         output=cache.Load(key, input.get());
+      }
 
-      if(isReference){
-         logDest->LogInfo("Begin reference");
-         puzzle->ReferenceExecute(logDest.get(), input.get(), output.get());
-         logDest->LogInfo("Finished reference");
-      }else{
-         logDest->LogInfo("Begin execution");
-         puzzle->Execute(logDest.get(), input.get(), output.get());
-         logDest->LogInfo("Finished execution");
+      if(!output){
+         output=puzzle->MakeEmptyOutput(input.get());
+
+         if(isReference){
+            logDest->LogInfo("Begin reference");
+            puzzle->ReferenceExecute(logDest.get(), input.get(), output.get());
+            logDest->LogInfo("Finished reference");
+         }else{
+            logDest->LogInfo("Begin execution");
+            puzzle->Execute(logDest.get(), input.get(), output.get());
+            logDest->LogInfo("Finished execution");
+         }
+
+         if(!key.empty())
+            cache.Store(key, output.get());
       }
 
       {
-         puzzler::StdoutStream dst;
+         puzzler::StdoutStream out;
+         puzzler::BufferedStream buffered(&out);
+         puzzler::CompressedStream dst(&buffered, puzzler::CompressedStream::Requested());
          puzzler::PersistContext ctxt(&dst, true);
 
          output->Persist(ctxt);
+         dst.Flush();
+         buffered.Flush();
       }
 
    }catch(std::string &msg){
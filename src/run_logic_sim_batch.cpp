@@ -0,0 +1,71 @@
+
+#include "puzzler/puzzler.hpp"
+#include "puzzler/puzzles/logic_sim.hpp"
+
+#include <iostream>
+
+
+int main(int argc, char *argv[])
+{
+   puzzler::PuzzleRegistrar::UserRegisterPuzzles();
+
+   if(argc<4){
+      fprintf(stderr, "run_logic_sim_batch scale states logLevel\n");
+      exit(1);
+   }
+
+   try{
+      int scale=atoi(argv[1]);
+      int states=atoi(argv[2]);
+
+      int logLevel=atoi(argv[3]);
+
+      std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("run_logic_sim_batch", logLevel);
+      logDest->Log(puzzler::Log_Info, "Created log.");
+
+      auto generic=puzzler::PuzzleRegistrar::Lookup("logic_sim");
+      auto puzzle=std::dynamic_pointer_cast<puzzler::LogicSimPuzzle>(generic);
+      if(!puzzle)
+	 throw std::runtime_error("No logic_sim puzzle registered");
+
+      logDest->LogInfo("Creating random input");
+      auto input=std::dynamic_pointer_cast<puzzler::LogicSimInput>(puzzle->CreateInput(logDest.get(), scale));
+
+      // The first state is the input's own, the rest are random
+      std::mt19937 rnd(time(0));
+      std::vector<std::vector<bool> > inputStates(states, input->inputState);
+      for(int i=1; i<states; i++){
+         for(unsigned j=0; j<inputStates[i].size(); j++)
+            inputStates[i][j] = 1 == (rnd()&1);
+      }
+
+      logDest->LogInfo("Executing batch of %d states", states);
+      auto got=puzzle->ExecuteBatch(logDest.get(), input.get(), inputStates);
+
+      logDest->LogInfo("Checking outputs against the reference");
+      puzzler::LogicSimInput tmp(*input);
+      for(int i=0; i<states; i++){
+         tmp.inputState=inputStates[i];
+         auto ref=puzzle->MakeEmptyOutput(&tmp);
+         generic->ReferenceExecute(logDest.get(), &tmp, ref.get());
+         if(!ref->Equals(got[i].get())){
+            logDest->LogFatal("Output for state %d is not correct.", i);
+            exit(1);
+         }
+      }
+      logDest->LogInfo("All %d outputs are correct", states);
+
+   }catch(std::string &msg){
+      std::cerr<<"Caught error string : "<<msg<<std::endl;
+      return 1;
+   }catch(std::exception &e){
+      std::cerr<<"Caught exception : "<<e.what()<<std::endl;
+      return 1;
+   }catch(...){
+      std::cerr<<"Caught unknown exception."<<std::endl;
+      return 1;
+   }
+
+   return 0;
+}
+
@@ -35,13 +35,33 @@ int main(int argc, char *argv[])
       logDest->LogInfo("Creating random input");
       auto input=puzzle->CreateInput(logDest.get(), scale);
 
-      logDest->LogInfo("Executing puzzle");
-      auto got=puzzle->MakeEmptyOutput(input.get());
-      puzzle->Execute(logDest.get(), input.get(), got.get());
+      puzzler::ResultCache cache(logDest.get());
 
-      logDest->LogInfo("Executing reference");
-      auto ref=puzzle->MakeEmptyOutput(input.get());
-      puzzle->ReferenceExecute(logDest.get(), input.get(), ref.get());
+      std::shared_ptr<puzzler::Puzzle::Output> got, ref;
+      std::string gotKey, refKey;
+      if(cache.Covers(false)){
+         gotKey=cache.Key(puzzler::ResultCache::ImplementationId(false), input.get());
+         got=cache.Load(gotKey, input.get());
+      }
+      if(!got){
+         logDest->LogInfo("Executing puzzle");
+         got=puzzle->MakeEmptyOutput(input.get());
+         puzzle->Execute(logDest.get(), input.get(), got.get());
+         if(!gotKey.empty())
+            cache.Store(gotKey, got.get());
+      }
+
+      if(cache.Covers(true)){
+         refKey=cache.Key(puzzler::ResultCache::ImplementationId(true), input.get());
+         ref=cache.Load(refKey, input.get());
+      }
+      if(!ref){
+         logDest->LogInfo("Executing reference");
+         ref=puzzle->MakeEmptyOutput(input.get());
+         puzzle->ReferenceExecute(logDest.get(), input.get(), ref.get());
+         if(!refKey.empty())
+            cache.Store(refKey, ref.get());
+      }
 
       logDest->LogInfo("Checking output");
       if(!ref->Equals(got.get())){